@@ -44,8 +44,7 @@ IAVersioneer gVersioneer;
  */
 const char *gVersion = /*[ver*/"v0.3.2b"/*]*/;
 
-//const int kFramebufferSize = 2048;
-const int kFramebufferSize = 4096;
+const int kMaxFramebufferSize = 8192;
 
 
 #ifdef __APPLE__
@@ -35,18 +35,18 @@ class IAPrinter;
 extern const char *gVersion;
 
 /**
- * The resolution of all frambuffer objects.
- * 1024 is pretty much the minimum. 2048 brings ok results. At 4096,
- * toolpaths are really nice, but rendering time slows down considerably.
- * At higher resolutions, toolpaths are perfect, but rendering time and
- * memory usage explode.
+ * The largest width or height of a framebuffer object.
+ * The actual resolution is set per printer by IAPrinter::rasterPitch. At
+ * 4096 pixels, toolpaths are really nice, but rendering time slows down
+ * considerably. At higher resolutions, toolpaths are perfect, but rendering
+ * time and memory usage explode.
  *
  * \todo nothing is optimized here yet. There is a great potential for
  *        accelerating, manly potrace, and reduced memory allocation by
  *        smart clipping.
  * \todo draw scene viewer with antaliasing!
  */
-extern const int kFramebufferSize;
+extern const int kMaxFramebufferSize;
 
 /**
  * temp kludge
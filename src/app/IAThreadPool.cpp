@@ -0,0 +1,93 @@
+//
+//  IAThreadPool.cpp
+//
+//  Copyright (c) 2013-2018 Matthias Melcher. All rights reserved.
+//
+
+
+#include "IAThreadPool.h"
+
+
+/**
+ * Return the pool that is shared by the entire app.
+ */
+IAThreadPool &IAThreadPool::shared()
+{
+    static IAThreadPool pool;
+    return pool;
+}
+
+
+/**
+ * Stop all workers and wait for them to end.
+ */
+IAThreadPool::~IAThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(pMutex);
+        pQuit = true;
+    }
+    pWake.notify_all();
+    for (auto &t: pWorker)
+        t.join();
+}
+
+
+/**
+ * Run a job on several threads at once and wait until all of them are done.
+ *
+ * The calling thread runs the job as well, so nThreads-1 workers are woken
+ * up. The job must find its own share of the work, usually by taking the
+ * next item from an atomic counter.
+ *
+ * \param nThreads number of threads that run the job, including the caller
+ * \param job the function that every thread calls once
+ */
+void IAThreadPool::run(int nThreads, const std::function<void()> &job)
+{
+    if (nThreads<=1) {
+        job();
+        return;
+    }
+    std::lock_guard<std::mutex> runLock(pRunMutex);
+    {
+        std::lock_guard<std::mutex> lock(pMutex);
+        while ((int)pWorker.size()<nThreads-1) {
+            int index = (int)pWorker.size();
+            pWorker.push_back(std::thread(&IAThreadPool::work, this, index));
+        }
+        pJob = &job;
+        pNeeded = nThreads-1;
+        pBusy = pNeeded;
+        pGeneration++;
+    }
+    pWake.notify_all();
+    job();
+    std::unique_lock<std::mutex> lock(pMutex);
+    pDone.wait(lock, [this]{ return pBusy==0; });
+    pJob = nullptr;
+}
+
+
+/**
+ * The loop of a worker thread.
+ *
+ * \param index workers run a job only if their index is below pNeeded
+ */
+void IAThreadPool::work(int index)
+{
+    std::unique_lock<std::mutex> lock(pMutex);
+    // workers are created for the job that run() is about to start
+    unsigned seen = pGeneration-1;
+    for (;;) {
+        pWake.wait(lock, [&]{ return pQuit || pGeneration!=seen; });
+        if (pQuit) break;
+        seen = pGeneration;
+        if (index>=pNeeded) continue;
+        lock.unlock();
+        (*pJob)();
+        lock.lock();
+        if (--pBusy==0)
+            pDone.notify_one();
+    }
+}
@@ -0,0 +1,66 @@
+//
+//  IAThreadPool.h
+//
+//  Copyright (c) 2013-2018 Matthias Melcher. All rights reserved.
+//
+
+#ifndef IA_THREAD_POOL_H
+#define IA_THREAD_POOL_H
+
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/**
+ * A set of worker threads that stay alive for the entire session.
+ *
+ * Slicing traces several bitmaps per layer. Starting new threads for every
+ * trace would cost more than the trace itself for small layers. Workers are
+ * created the first time they are needed and then sleep until the next job.
+ */
+class IAThreadPool
+{
+public:
+    static IAThreadPool &shared();
+
+    ~IAThreadPool();
+    void run(int nThreads, const std::function<void()> &job);
+
+protected:
+    void work(int index);
+
+    /** Only one job runs at a time */
+    std::mutex pRunMutex;
+
+    /** Protects all members below */
+    std::mutex pMutex;
+
+    /** Wakes up the workers for a new job or to quit */
+    std::condition_variable pWake;
+
+    /** Tells run() that the last worker is done */
+    std::condition_variable pDone;
+
+    std::vector<std::thread> pWorker;
+
+    /** The current job; valid until all workers are done */
+    const std::function<void()> *pJob = nullptr;
+
+    /** Increases with every job, so workers know that they have a new one */
+    unsigned pGeneration = 0;
+
+    /** Workers with a lower index run the current job */
+    int pNeeded = 0;
+
+    /** Number of workers that have not finished the current job yet */
+    int pBusy = 0;
+
+    bool pQuit = false;
+};
+
+
+#endif /* IA_THREAD_POOL_H */
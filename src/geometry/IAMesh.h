@@ -43,7 +43,6 @@ public:
     virtual void clear();
     bool validate();
     void draw(Shader s=kFLAT, float r=0.6f, float g=0.6, float b=0.6, float a=1.0);
-    void drawAngledFaces(double a);
 //    void drawShrunk(unsigned int, double);
     void drawEdges();
     void drawSliced(double z);
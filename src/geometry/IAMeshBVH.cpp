@@ -0,0 +1,475 @@
+//
+//  IAMeshBVH.cpp
+//
+//  Copyright (c) 2013-2018 Matthias Melcher. All rights reserved.
+//
+
+
+#include "IAMeshBVH.h"
+
+#include "geometry/IAMesh.h"
+#include "geometry/IATriangle.h"
+#include "geometry/IAVertex.h"
+
+#include <algorithm>
+#include <math.h>
+
+
+/** Number of bins when searching for the best split of a node. */
+static const int kNumBins = 12;
+
+/** Nodes with this many triangles or less may become leafs. */
+static const int kMaxLeafSize = 8;
+
+/** Size of the traversal stack; nodes at this depth are not split any further. */
+static const int kMaxStack = 64;
+
+
+static inline void sub(const double *a, const double *b, double *r)
+{
+    r[0] = a[0]-b[0]; r[1] = a[1]-b[1]; r[2] = a[2]-b[2];
+}
+
+static inline void cross(const double *a, const double *b, double *r)
+{
+    r[0] = a[1]*b[2] - a[2]*b[1];
+    r[1] = a[2]*b[0] - a[0]*b[2];
+    r[2] = a[0]*b[1] - a[1]*b[0];
+}
+
+static inline double dot(const double *a, const double *b)
+{
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+static inline double surfaceArea(const double *mn, const double *mx)
+{
+    double dx = mx[0]-mn[0], dy = mx[1]-mn[1], dz = mx[2]-mn[2];
+    return 2.0*(dx*dy + dy*dz + dz*dx);
+}
+
+
+/**
+ * Create an empty tree.
+ */
+IAMeshBVH::IAMeshBVH()
+{
+}
+
+
+/**
+ * Create a tree for all triangles in a mesh.
+ */
+IAMeshBVH::IAMeshBVH(IAMesh *mesh)
+{
+    build(mesh);
+}
+
+
+/**
+ * Remove all nodes and triangles.
+ */
+void IAMeshBVH::clear()
+{
+    pNode.clear();
+    pTri.clear();
+    pTriangle.clear();
+}
+
+
+/**
+ * Build the tree from the global position of all triangles in a mesh.
+ *
+ * \param mesh the mesh; the tree does not keep a reference to it
+ */
+void IAMeshBVH::build(IAMesh *mesh)
+{
+    clear();
+    if (!mesh) return;
+    int n = (int)mesh->triangleList.size();
+    if (n==0) return;
+
+    std::vector<double> bounds(6*n), centers(3*n);
+    std::vector<int> ix(n);
+    for (int i=0; i<n; i++) {
+        IATriangle *t = mesh->triangleList[i];
+        double *mn = &bounds[6*i], *mx = mn+3;
+        for (int a=0; a<3; a++) { mn[a] = DBL_MAX; mx[a] = -DBL_MAX; }
+        for (int j=0; j<3; j++) {
+            double *v = t->vertex(j)->pGlobalPosition.dataPointer();
+            for (int a=0; a<3; a++) {
+                if (v[a]<mn[a]) mn[a] = v[a];
+                if (v[a]>mx[a]) mx[a] = v[a];
+            }
+        }
+        for (int a=0; a<3; a++)
+            centers[3*i+a] = 0.5*(mn[a]+mx[a]);
+        ix[i] = i;
+    }
+
+    pNode.reserve(2*n);
+    buildNode(ix, 0, n, bounds, centers, 0);
+
+    // store the triangles in the order of the leafs
+    pTri.resize(n);
+    pTriangle.resize(n);
+    for (int i=0; i<n; i++) {
+        IATriangle *t = mesh->triangleList[ix[i]];
+        Tri &d = pTri[i];
+        double *v0 = t->vertex(0)->pGlobalPosition.dataPointer();
+        double *v1 = t->vertex(1)->pGlobalPosition.dataPointer();
+        double *v2 = t->vertex(2)->pGlobalPosition.dataPointer();
+        for (int a=0; a<3; a++) d.pV0[a] = v0[a];
+        sub(v1, v0, d.pE1);
+        sub(v2, v0, d.pE2);
+        pTriangle[i] = t;
+    }
+}
+
+
+/**
+ * Create a node and all its children.
+ *
+ * A node is split where the surface area heuristic estimates the lowest
+ * cost for a ray traversal. Candidates are the borders of equally sized
+ * bins along all three axes.
+ *
+ * \param ix triangle indices; the range of this node will be reordered
+ * \param first, count the range of triangles in ix
+ * \param bounds, centers bounding boxes and centers of all triangles
+ * \param depth depth of this node in the tree
+ * \return index of the new node
+ */
+int IAMeshBVH::buildNode(std::vector<int> &ix, int first, int count,
+                         const std::vector<double> &bounds, const std::vector<double> &centers,
+                         int depth)
+{
+    int self = (int)pNode.size();
+    pNode.push_back(Node());
+    double mn[3] = { DBL_MAX, DBL_MAX, DBL_MAX }, mx[3] = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+    double cmn[3] = { DBL_MAX, DBL_MAX, DBL_MAX }, cmx[3] = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+    for (int i=first; i<first+count; i++) {
+        const double *b = &bounds[6*ix[i]], *c = &centers[3*ix[i]];
+        for (int a=0; a<3; a++) {
+            if (b[a]<mn[a]) mn[a] = b[a];
+            if (b[a+3]>mx[a]) mx[a] = b[a+3];
+            if (c[a]<cmn[a]) cmn[a] = c[a];
+            if (c[a]>cmx[a]) cmx[a] = c[a];
+        }
+    }
+    for (int a=0; a<3; a++) {
+        pNode[self].pMin[a] = mn[a];
+        pNode[self].pMax[a] = mx[a];
+    }
+    pNode[self].pFirst = first;
+    pNode[self].pCount = count;
+    if (count<=2 || depth>=kMaxStack-2)
+        return self;
+
+    // find the cheapest split
+    int bestAxis = -1, bestBin = 0;
+    double bestCost = DBL_MAX;
+    for (int a=0; a<3; a++) {
+        double extent = cmx[a]-cmn[a];
+        if (extent<=0.0) continue;
+        int binCount[kNumBins] = { 0 };
+        double binMin[kNumBins][3], binMax[kNumBins][3];
+        for (int k=0; k<kNumBins; k++) {
+            for (int j=0; j<3; j++) { binMin[k][j] = DBL_MAX; binMax[k][j] = -DBL_MAX; }
+        }
+        double scale = kNumBins/extent;
+        for (int i=first; i<first+count; i++) {
+            int k = (int)((centers[3*ix[i]+a]-cmn[a])*scale);
+            if (k>=kNumBins) k = kNumBins-1;
+            binCount[k]++;
+            const double *b = &bounds[6*ix[i]];
+            for (int j=0; j<3; j++) {
+                if (b[j]<binMin[k][j]) binMin[k][j] = b[j];
+                if (b[j+3]>binMax[k][j]) binMax[k][j] = b[j+3];
+            }
+        }
+        // sweep from the right, then from the left
+        double rightArea[kNumBins];
+        int rightCount[kNumBins];
+        double rmn[3] = { DBL_MAX, DBL_MAX, DBL_MAX }, rmx[3] = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+        int rn = 0;
+        for (int k=kNumBins-1; k>0; k--) {
+            rn += binCount[k];
+            for (int j=0; j<3; j++) {
+                rmn[j] = std::min(rmn[j], binMin[k][j]);
+                rmx[j] = std::max(rmx[j], binMax[k][j]);
+            }
+            rightCount[k] = rn;
+            rightArea[k] = rn ? surfaceArea(rmn, rmx) : 0.0;
+        }
+        double lmn[3] = { DBL_MAX, DBL_MAX, DBL_MAX }, lmx[3] = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+        int ln = 0;
+        for (int k=1; k<kNumBins; k++) {
+            ln += binCount[k-1];
+            for (int j=0; j<3; j++) {
+                lmn[j] = std::min(lmn[j], binMin[k-1][j]);
+                lmx[j] = std::max(lmx[j], binMax[k-1][j]);
+            }
+            if (ln==0 || rightCount[k]==0) continue;
+            double cost = ln*surfaceArea(lmn, lmx) + rightCount[k]*rightArea[k];
+            if (cost<bestCost) {
+                bestCost = cost;
+                bestAxis = a;
+                bestBin = k;
+            }
+        }
+    }
+
+    double area = surfaceArea(mn, mx);
+    bool split = (bestAxis>=0);
+    if (split && area>0.0 && 1.0+bestCost/area>=count && count<=kMaxLeafSize)
+        split = false;
+    if (!split && count<=kMaxLeafSize)
+        return self;
+
+    int mid;
+    if (split) {
+        int a = bestAxis;
+        double scale = kNumBins/(cmx[a]-cmn[a]);
+        auto it = std::partition(ix.begin()+first, ix.begin()+first+count, [&](int i) {
+            int k = (int)((centers[3*i+a]-cmn[a])*scale);
+            if (k>=kNumBins) k = kNumBins-1;
+            return k<bestBin;
+        });
+        mid = (int)(it-ix.begin());
+    } else {
+        // all centers are in the same spot; split the list in half
+        mid = first + count/2;
+    }
+    if (mid<=first || mid>=first+count)
+        mid = first + count/2;
+
+    buildNode(ix, first, mid-first, bounds, centers, depth+1);
+    int right = buildNode(ix, mid, first+count-mid, bounds, centers, depth+1);
+    pNode[self].pFirst = right;
+    pNode[self].pCount = 0;
+    return self;
+}
+
+
+/**
+ * Precompute the values that every box and triangle test needs.
+ */
+void IAMeshBVH::prepare(const Ray &ray, Query &q)
+{
+    q.pOrigin[0] = ray.pOrigin.x(); q.pOrigin[1] = ray.pOrigin.y(); q.pOrigin[2] = ray.pOrigin.z();
+    q.pDir[0] = ray.pDirection.x(); q.pDir[1] = ray.pDirection.y(); q.pDir[2] = ray.pDirection.z();
+    for (int a=0; a<3; a++) {
+        q.pInvDir[a] = 1.0/q.pDir[a];
+    }
+    q.pMaxT = ray.pMaxT;
+}
+
+
+/**
+ * Test if a ray enters a node before it reaches tMax.
+ *
+ * \param tEntry receives the distance at which the ray enters the box
+ */
+bool IAMeshBVH::hitBox(const Node &n, const Query &q, double tMax, double &tEntry) const
+{
+    double t0 = 0.0, t1 = tMax;
+    for (int a=0; a<3; a++) {
+        double tn = (n.pMin[a]-q.pOrigin[a])*q.pInvDir[a];
+        double tf = (n.pMax[a]-q.pOrigin[a])*q.pInvDir[a];
+        if (tn>tf) std::swap(tn, tf);
+        // comparisons are written so that NaN does not change the interval
+        t0 = tn>t0 ? tn : t0;
+        t1 = tf<t1 ? tf : t1;
+        if (t0>t1) return false;
+    }
+    tEntry = t0;
+    return true;
+}
+
+
+/**
+ * Intersect a ray with a triangle, using the Moeller-Trumbore test.
+ *
+ * \param t receives the distance along the ray
+ * \return true if the ray hits the triangle in front of its origin
+ */
+bool IAMeshBVH::hitTriangle(int i, const Query &q, double &t) const
+{
+    const Tri &d = pTri[i];
+    double p[3], s[3], qv[3];
+    cross(q.pDir, d.pE2, p);
+    double det = dot(d.pE1, p);
+    if (fabs(det)<1e-14) return false;
+    double inv = 1.0/det;
+    sub(q.pOrigin, d.pV0, s);
+    double u = dot(s, p)*inv;
+    if (u<0.0 || u>1.0) return false;
+    cross(s, d.pE1, qv);
+    double v = dot(q.pDir, qv)*inv;
+    if (v<0.0 || u+v>1.0) return false;
+    t = dot(d.pE2, qv)*inv;
+    return t>1e-9;
+}
+
+
+/**
+ * Find the first triangle along a ray.
+ *
+ * \param ray the ray
+ * \param hit receives the triangle and distance; unchanged if nothing was hit
+ * \return true if a triangle was hit
+ */
+bool IAMeshBVH::closestHit(const Ray &ray, Hit &hit) const
+{
+    if (pNode.empty()) return false;
+    Query q;
+    prepare(ray, q);
+    double best = q.pMaxT, t, tEntry;
+    int bestTri = -1;
+    int stack[kMaxStack], sp = 0;
+    stack[sp++] = 0;
+    while (sp) {
+        const Node &n = pNode[stack[--sp]];
+        if (!hitBox(n, q, best, tEntry)) continue;
+        if (n.pCount) {
+            for (int i=n.pFirst; i<n.pFirst+n.pCount; i++) {
+                if (hitTriangle(i, q, t) && t<best) {
+                    best = t;
+                    bestTri = i;
+                }
+            }
+        } else {
+            // visit the nearer child first
+            int left = (int)(&n-pNode.data())+1, right = n.pFirst;
+            double tl = DBL_MAX, tr = DBL_MAX;
+            bool hl = hitBox(pNode[left], q, best, tl);
+            bool hr = hitBox(pNode[right], q, best, tr);
+            if (hl && hr) {
+                if (tl<tr) std::swap(left, right);
+                stack[sp++] = left;
+                stack[sp++] = right;
+            } else if (hl) {
+                stack[sp++] = left;
+            } else if (hr) {
+                stack[sp++] = right;
+            }
+        }
+    }
+    if (bestTri<0) return false;
+    hit.pTriangle = pTriangle[bestTri];
+    hit.pT = best;
+    return true;
+}
+
+
+/**
+ * Return true if a ray hits any triangle before reaching its maximum length.
+ */
+bool IAMeshBVH::anyHit(const Ray &ray) const
+{
+    if (pNode.empty()) return false;
+    Query q;
+    prepare(ray, q);
+    double t, tEntry;
+    int stack[kMaxStack], sp = 0;
+    stack[sp++] = 0;
+    while (sp) {
+        const Node &n = pNode[stack[--sp]];
+        if (!hitBox(n, q, q.pMaxT, tEntry)) continue;
+        if (n.pCount) {
+            for (int i=n.pFirst; i<n.pFirst+n.pCount; i++) {
+                if (hitTriangle(i, q, t) && t<q.pMaxT)
+                    return true;
+            }
+        } else {
+            stack[sp++] = n.pFirst;
+            stack[sp++] = (int)(&n-pNode.data())+1;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Count all triangles that a ray crosses.
+ */
+int IAMeshBVH::countCrossings(const Query &q) const
+{
+    int count = 0;
+    double t, tEntry;
+    int stack[kMaxStack], sp = 0;
+    stack[sp++] = 0;
+    while (sp) {
+        const Node &n = pNode[stack[--sp]];
+        if (!hitBox(n, q, q.pMaxT, tEntry)) continue;
+        if (n.pCount) {
+            for (int i=n.pFirst; i<n.pFirst+n.pCount; i++) {
+                if (hitTriangle(i, q, t))
+                    count++;
+            }
+        } else {
+            stack[sp++] = n.pFirst;
+            stack[sp++] = (int)(&n-pNode.data())+1;
+        }
+    }
+    return count;
+}
+
+
+/**
+ * Return true if a point is inside the solid described by the mesh.
+ *
+ * A ray is cast from the point, and the point is inside, if the ray leaves
+ * the mesh more often than it enters it. The mesh must be closed.
+ *
+ * \todo A ray that grazes an edge may be counted twice or not at all. The
+ *      direction is chosen to make this unlikely for CAD models.
+ */
+bool IAMeshBVH::isInside(const IAVector3d &point) const
+{
+    if (pNode.empty()) return false;
+    Ray ray;
+    ray.pOrigin = point;
+    ray.pDirection = IAVector3d(0.3141592, 0.2718281, 0.9092974);
+    Query q;
+    prepare(ray, q);
+    return (countCrossings(q) & 1) == 1;
+}
+
+
+/**
+ * Find the first triangle along every ray in a list.
+ *
+ * \param rays a list of rays
+ * \param hits receives one entry per ray; pTriangle is nullptr for misses
+ */
+void IAMeshBVH::closestHit(const std::vector<Ray> &rays, std::vector<Hit> &hits) const
+{
+    hits.assign(rays.size(), Hit());
+    for (size_t i=0; i<rays.size(); i++)
+        closestHit(rays[i], hits[i]);
+}
+
+
+/**
+ * Find out for every ray in a list if it hits any triangle.
+ */
+void IAMeshBVH::anyHit(const std::vector<Ray> &rays, std::vector<bool> &hits) const
+{
+    hits.resize(rays.size());
+    for (size_t i=0; i<rays.size(); i++)
+        hits[i] = anyHit(rays[i]);
+}
+
+
+/**
+ * Find out for every point in a list if it is inside the solid.
+ */
+void IAMeshBVH::isInside(const std::vector<IAVector3d> &points, std::vector<bool> &inside) const
+{
+    inside.resize(points.size());
+    for (size_t i=0; i<points.size(); i++)
+        inside[i] = isInside(points[i]);
+}
+
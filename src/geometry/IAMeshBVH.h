@@ -0,0 +1,101 @@
+//
+//  IAMeshBVH.h
+//
+//  Copyright (c) 2013-2018 Matthias Melcher. All rights reserved.
+//
+
+#ifndef IA_MESH_BVH_H
+#define IA_MESH_BVH_H
+
+
+#include "IAVector3d.h"
+
+#include <vector>
+#include <float.h>
+
+
+class IAMesh;
+class IATriangle;
+
+
+/**
+ * A bounding volume hierarchy over all triangles of a mesh.
+ *
+ * The tree is built once from the global vertex positions of a mesh, using
+ * the surface area heuristic to split nodes. It answers ray queries and
+ * point-in-solid queries in logarithmic time instead of testing every
+ * triangle. Queries can be given one by one or in batches.
+ *
+ * The tree is a snapshot. If the mesh is moved or modified, the tree must
+ * be built again.
+ */
+class IAMeshBVH
+{
+public:
+    /** A ray from an origin along a direction, up to a maximum distance. */
+    struct Ray {
+        IAVector3d pOrigin;
+        IAVector3d pDirection;
+        double pMaxT = DBL_MAX;
+    };
+
+    /** Where a ray hits the mesh first. */
+    struct Hit {
+        /** The triangle that was hit, or nullptr if the ray hit nothing */
+        IATriangle *pTriangle = nullptr;
+        /** Distance along the ray in units of the ray direction */
+        double pT = DBL_MAX;
+    };
+
+    IAMeshBVH();
+    IAMeshBVH(IAMesh *mesh);
+    void build(IAMesh *mesh);
+    void clear();
+
+    /** Return true if the tree contains no triangles. */
+    bool isEmpty() const { return pNode.empty(); }
+
+    bool closestHit(const Ray &ray, Hit &hit) const;
+    bool anyHit(const Ray &ray) const;
+    bool isInside(const IAVector3d &point) const;
+
+    void closestHit(const std::vector<Ray> &rays, std::vector<Hit> &hits) const;
+    void anyHit(const std::vector<Ray> &rays, std::vector<bool> &hits) const;
+    void isInside(const std::vector<IAVector3d> &points, std::vector<bool> &inside) const;
+
+protected:
+    /** A node in the flattened tree. */
+    struct Node {
+        double pMin[3], pMax[3];
+        /** Index of the first triangle in a leaf, or of the second child */
+        int pFirst;
+        /** Number of triangles in a leaf, 0 for inner nodes; the first child follows its parent */
+        int pCount;
+    };
+
+    /** Triangle data, prepared for a fast intersection test. */
+    struct Tri {
+        double pV0[3], pE1[3], pE2[3];
+    };
+
+    /** Precomputed values for one ray. */
+    struct Query {
+        double pOrigin[3], pDir[3], pInvDir[3];
+        double pMaxT;
+    };
+
+    int buildNode(std::vector<int> &ix, int first, int count,
+                  const std::vector<double> &bounds, const std::vector<double> &centers,
+                  int depth);
+    static void prepare(const Ray &ray, Query &q);
+    bool hitBox(const Node &n, const Query &q, double tMax, double &tEntry) const;
+    bool hitTriangle(int i, const Query &q, double &t) const;
+    int countCrossings(const Query &q) const;
+
+    std::vector<Node> pNode;
+    std::vector<Tri> pTri;
+    std::vector<IATriangle*> pTriangle;
+};
+
+
+#endif /* IA_MESH_BVH_H */
@@ -57,6 +57,7 @@ void IAMeshSlice::clear()
         delete e;
     }
     pRim.clear();
+    pColorbuffer->updateSize();
     pColorbuffer->fill(0);
     IAMesh::clear();
 }
@@ -435,7 +436,7 @@ void IAMeshSlice::tesselateLidFromRim()
 void IAMeshSlice::tesselateAndDrawLid(IAFramebuffer *fb)
 {
     fb->bindForRendering(); // make sure we have a square in the buffer
-    if (fb->buffers()==IAFramebuffer::BITMAP) {
+    if (fb->isBitmap()) {
         fb->drawLid(pRim);
     } else {
         tesselateLidFromRim();
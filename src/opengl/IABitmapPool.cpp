@@ -0,0 +1,72 @@
+//
+//  IABitmapPool.cpp
+//
+//  Copyright (c) 2013-2018 Matthias Melcher. All rights reserved.
+//
+
+
+#include "IABitmapPool.h"
+
+#include "potrace/bitmap.h"
+
+
+std::mutex IABitmapPool::pMutex;
+std::vector<potrace_bitmap_t*> IABitmapPool::pFree;
+
+
+/**
+ * Get a bitmap of the given size, recycled if possible.
+ *
+ * \param w, h size of the bitmap in pixels
+ * \return a bitmap with undefined content, or an empty pointer if we ran
+ *      out of memory
+ */
+IABitmapSP IABitmapPool::acquire(int w, int h)
+{
+    potrace_bitmap_t *bm = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(pMutex);
+        for (size_t i=0; i<pFree.size(); i++) {
+            if (pFree[i]->w==w && pFree[i]->h==h) {
+                bm = pFree[i];
+                pFree[i] = pFree.back();
+                pFree.pop_back();
+                break;
+            }
+        }
+    }
+    if (!bm)
+        bm = bm_new(w, h);
+    if (!bm)
+        return nullptr;
+    return IABitmapSP(bm, release);
+}
+
+
+/**
+ * Return a bitmap to the pool, or free it if the pool is full.
+ */
+void IABitmapPool::release(potrace_bitmap_t *bm)
+{
+    {
+        std::lock_guard<std::mutex> lock(pMutex);
+        if (pFree.size()<kMaxFree) {
+            pFree.push_back(bm);
+            return;
+        }
+    }
+    bm_free(bm);
+}
+
+
+/**
+ * Free all bitmaps that are currently not in use.
+ */
+void IABitmapPool::purge()
+{
+    std::lock_guard<std::mutex> lock(pMutex);
+    for (auto bm: pFree)
+        bm_free(bm);
+    pFree.clear();
+}
+
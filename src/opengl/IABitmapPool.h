@@ -0,0 +1,49 @@
+//
+//  IABitmapPool.h
+//
+//  Copyright (c) 2013-2018 Matthias Melcher. All rights reserved.
+//
+
+#ifndef IA_BITMAP_POOL_H
+#define IA_BITMAP_POOL_H
+
+
+#include "potrace/potracelib.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+typedef std::shared_ptr<potrace_bitmap_t> IABitmapSP;
+
+
+/**
+ * Keep released potrace bitmaps around so that the next layer can reuse them.
+ *
+ * Slicing a layer creates and destroys several bitmaps of the same size.
+ * Recycling them avoids the allocator and, more importantly, the page faults
+ * when fresh memory is touched for the first time.
+ *
+ * Bitmaps are handed out as shared pointers that return the bitmap to the
+ * pool when the last owner lets go. The content of a recycled bitmap is
+ * undefined.
+ */
+class IABitmapPool
+{
+public:
+    static IABitmapSP acquire(int w, int h);
+    static void purge();
+
+protected:
+    static void release(potrace_bitmap_t *bm);
+
+    /** Never keep more than this many unused bitmaps. */
+    static const size_t kMaxFree = 8;
+
+    static std::mutex pMutex;
+    static std::vector<potrace_bitmap_t*> pFree;
+};
+
+
+#endif /* IA_BITMAP_POOL_H */
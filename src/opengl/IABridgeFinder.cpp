@@ -0,0 +1,160 @@
+//
+//  IABridgeFinder.cpp
+//
+//  Copyright (c) 2013-2018 Matthias Melcher. All rights reserved.
+//
+
+
+#include "IABridgeFinder.h"
+
+#include "opengl/IAFramebuffer.h"
+#include "potrace/bitmap.h"
+
+#include <string.h>
+
+
+static inline bool getBit(const potrace_word *row, int x)
+{
+    return (row[x/BM_WORDBITS] & bm_mask(x)) != 0;
+}
+
+
+/**
+ * Prepare to find bridges in layers of a given size.
+ *
+ * \param w, h size of a layer in pixels
+ * \param maxSpan longest bridge in pixels
+ */
+IABridgeFinder::IABridgeFinder(int w, int h, int maxSpan)
+:   pWidth( w ),
+    pHeight( h ),
+    pWords( w==0 ? 0 : (w-1)/BM_WORDBITS+1 ),
+    pMaxSpan( maxSpan )
+{
+}
+
+
+/**
+ * Find the bridged pixels of a layer.
+ *
+ * \param layer the entire slice of the layer
+ * \param below the entire slice of the layer below
+ * \param dst receives the bridged pixels in the chosen direction
+ * \return 0 if the bridges run along the x axis, 90 if they run along
+ *      the y axis, or -1 if there are no bridges
+ */
+int IABridgeFinder::find(IAFramebuffer *layer, IAFramebuffer *below, potrace_bitmap_t *dst)
+{
+    pLayer.resize((size_t)pWords*pHeight);
+    pBelow.resize((size_t)pWords*pHeight);
+    for (int y=0; y<pHeight; y++) {
+        layer->readRow(y, pLayer.data() + (size_t)y*pWords);
+        below->readRow(y, pBelow.data() + (size_t)y*pWords);
+    }
+
+    potrace_bitmap_t *alongY = bm_new(pWidth, pHeight);
+    bm_clear(dst, 0);
+    bm_clear(alongY, 0);
+    long nx = findAlongX(dst);
+    long ny = findAlongY(alongY);
+    int angle = -1;
+    if (ny>nx) {
+        memcpy(bm_base(dst), bm_base(alongY), bm_size(dst));
+        angle = 90;
+    } else if (nx>0) {
+        angle = 0;
+    }
+    bm_free(alongY);
+    return angle;
+}
+
+
+/**
+ * Mark all overhang spans along scanlines that are anchored on both ends.
+ *
+ * \return number of bridged pixels
+ */
+long IABridgeFinder::findAlongX(potrace_bitmap_t *dst)
+{
+    long n = 0;
+    for (int y=0; y<pHeight; y++) {
+        const potrace_word *l = pLayer.data() + (size_t)y*pWords;
+        const potrace_word *b = pBelow.data() + (size_t)y*pWords;
+        bool any = false;
+        for (int i=0; i<pWords; i++) {
+            if (l[i] & ~b[i]) { any = true; break; }
+        }
+        if (!any) continue;
+        int x = 0;
+        while (x<pWidth) {
+            // skip to the start of the next overhang run
+            if (!getBit(l, x) || getBit(b, x)) {
+                x++;
+                continue;
+            }
+            int x0 = x;
+            while (x<pWidth && getBit(l, x) && !getBit(b, x)) x++;
+            // the run ends at the layer below or at the edge of the layer
+            bool anchored = (x0>0 && getBit(b, x0-1)) && (x<pWidth && getBit(b, x));
+            if (anchored && x-x0<=pMaxSpan) {
+                bm_hline(dst, x0, x, y, 1);
+                n += x-x0;
+            }
+        }
+    }
+    return n;
+}
+
+
+/**
+ * Mark all overhang spans across scanlines that are anchored on both ends.
+ *
+ * All columns are walked at once. Work is only done where a column enters
+ * or leaves an overhang, so the cost is low for layers with few overhangs.
+ *
+ * \return number of bridged pixels
+ */
+long IABridgeFinder::findAlongY(potrace_bitmap_t *dst)
+{
+    long n = 0;
+    // first row of the current run in every column, and if it is anchored
+    std::vector<int> start(pWidth, 0);
+    std::vector<char> anchored(pWidth, 0);
+    std::vector<potrace_word> prev(pWords, 0), curr(pWords, 0);
+    for (int y=0; y<=pHeight; y++) {
+        const potrace_word *b = pBelow.data() + (size_t)y*pWords;
+        if (y<pHeight) {
+            const potrace_word *l = pLayer.data() + (size_t)y*pWords;
+            for (int i=0; i<pWords; i++) curr[i] = l[i] & ~b[i];
+        } else {
+            for (int i=0; i<pWords; i++) curr[i] = 0;
+        }
+        for (int i=0; i<pWords; i++) {
+            potrace_word changed = curr[i] ^ prev[i];
+            while (changed) {
+                // find the leftmost changed column in this word
+                int k = 0;
+                while (!(changed & (BM_HIBIT>>k))) k++;
+                changed &= ~(BM_HIBIT>>k);
+                int x = i*BM_WORDBITS + k;
+                if (x>=pWidth) break;
+                if (curr[i] & (BM_HIBIT>>k)) {
+                    // a run starts here
+                    start[x] = y;
+                    anchored[x] = (y>0 && getBit(pBelow.data() + (size_t)(y-1)*pWords, x));
+                } else {
+                    // a run ended in the row below this one
+                    bool ok = anchored[x] && y<pHeight && getBit(b, x);
+                    if (ok && y-start[x]<=pMaxSpan) {
+                        for (int yy=start[x]; yy<y; yy++)
+                            BM_USET(dst, x, yy);
+                        n += y-start[x];
+                    }
+                }
+            }
+        }
+        prev.swap(curr);
+    }
+    return n;
+}
+
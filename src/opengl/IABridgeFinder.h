@@ -0,0 +1,57 @@
+//
+//  IABridgeFinder.h
+//
+//  Copyright (c) 2013-2018 Matthias Melcher. All rights reserved.
+//
+
+#ifndef IA_BRIDGE_FINDER_H
+#define IA_BRIDGE_FINDER_H
+
+
+#include "potrace/potracelib.h"
+
+#include <vector>
+
+
+class IAFramebuffer;
+
+
+/**
+ * Find the parts of a layer that can be printed as a bridge.
+ *
+ * Everything in a layer that is not in the layer below is an overhang. An
+ * overhang pixel is bridged, if a straight line along the x or y axis
+ * through the pixel runs over nothing but overhang until it reaches the
+ * layer below on both sides, and if that span is no longer than the
+ * maximum bridge length.
+ *
+ * Filament can be pulled across such a span from one anchor to the other,
+ * so these pixels need no support. The direction with more bridged pixels
+ * is chosen for the entire layer.
+ */
+class IABridgeFinder
+{
+public:
+    IABridgeFinder(int w, int h, int maxSpan);
+
+    int find(IAFramebuffer *layer, IAFramebuffer *below, potrace_bitmap_t *dst);
+
+protected:
+    long findAlongX(potrace_bitmap_t *dst);
+    long findAlongY(potrace_bitmap_t *dst);
+
+    int pWidth = 0;
+    int pHeight = 0;
+
+    /** Number of words in a scanline. */
+    int pWords = 0;
+
+    /** Longest bridge in pixels. */
+    int pMaxSpan = 0;
+
+    /** The layer and the layer below, pWords*pHeight words each. */
+    std::vector<potrace_word> pLayer, pBelow;
+};
+
+
+#endif /* IA_BRIDGE_FINDER_H */
@@ -0,0 +1,229 @@
+//
+//  IAComponentLabeler.cpp
+//
+//  Copyright (c) 2013-2018 Matthias Melcher. All rights reserved.
+//
+
+
+#include "IAComponentLabeler.h"
+
+#include "opengl/IAFramebuffer.h"
+#include "potrace/bitmap.h"
+
+#include <algorithm>
+
+
+static const potrace_word kAllBits = ~(potrace_word)0;
+
+
+static inline int leadingZeros(potrace_word w)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clzl(w);
+#else
+    int n = 0;
+    while (!(w & BM_HIBIT)) { w <<= 1; n++; }
+    return n;
+#endif
+}
+
+
+/**
+ * Find the first pixel at or after x that is set in a scanline.
+ *
+ * \param invert find the first pixel that is not set instead
+ * \return the pixel index, or width if there is none
+ */
+static int nextBit(const potrace_word *row, int x, int width, bool invert)
+{
+    if (x>=width) return width;
+    int nWords = (width+BM_WORDBITS-1)/BM_WORDBITS;
+    int i = x/BM_WORDBITS;
+    potrace_word flip = invert ? kAllBits : 0;
+    potrace_word w = (row[i]^flip) & (kAllBits>>(x%BM_WORDBITS));
+    while (!w) {
+        if (++i>=nWords) return width;
+        w = row[i]^flip;
+    }
+    return std::min(width, i*BM_WORDBITS + leadingZeros(w));
+}
+
+
+IAComponentLabeler::IAComponentLabeler()
+{
+}
+
+
+int IAComponentLabeler::findRoot(int i)
+{
+    while (pRun[i].parent!=i) {
+        // path halving keeps the trees flat
+        pRun[i].parent = pRun[pRun[i].parent].parent;
+        i = pRun[i].parent;
+    }
+    return i;
+}
+
+
+void IAComponentLabeler::unite(int a, int b)
+{
+    a = findRoot(a);
+    b = findRoot(b);
+    // the older run becomes the root, so roots are always the topmost run
+    if (a<b) pRun[b].parent = a;
+    else if (b<a) pRun[a].parent = b;
+}
+
+
+/**
+ * Append all runs of set pixels in a scanline.
+ */
+void IAComponentLabeler::addRuns(const potrace_word *row, int y, int width)
+{
+    int x = nextBit(row, 0, width, false);
+    while (x<width) {
+        int x1 = nextBit(row, x, width, true);
+        int ix = (int)pRun.size();
+        pRun.push_back( { x, x1, y, ix } );
+        x = nextBit(row, x1, width, false);
+    }
+}
+
+
+/**
+ * Find all 8-connected components in a BITMAP or TILED framebuffer.
+ *
+ * \param fb the framebuffer is read, but not modified
+ * \return the number of components
+ */
+int IAComponentLabeler::label(IAFramebuffer *fb)
+{
+    pRun.clear();
+    pRunComponent.clear();
+    pComponent.clear();
+    pComponentRun.clear();
+    pComponentRunStart.assign(1, 0);
+    if (!fb->isBitmap()) return 0;
+
+    int w = fb->width(), h = fb->height();
+    int nWords = (w+BM_WORDBITS-1)/BM_WORDBITS;
+    std::vector<potrace_word> row(nWords);
+    size_t prevStart = 0, prevEnd = 0;
+    for (int y=0; y<h; y++) {
+        fb->readRow(y, row.data());
+        size_t currStart = pRun.size();
+        addRuns(row.data(), y, w);
+        size_t currEnd = pRun.size();
+        // runs in both lines are sorted by x, so one pass finds all overlaps
+        size_t i = prevStart, j = currStart;
+        while (i<prevEnd && j<currEnd) {
+            const Run &a = pRun[i], &b = pRun[j];
+            if (a.x0<=b.x1 && b.x0<=a.x1)
+                unite((int)i, (int)j);
+            if (a.x1<b.x1) i++; else j++;
+        }
+        prevStart = currStart;
+        prevEnd = currEnd;
+    }
+
+    // give every root a component number and collect area and bounds
+    pRunComponent.resize(pRun.size());
+    for (size_t i=0; i<pRun.size(); i++) {
+        const Run &r = pRun[i];
+        int root = findRoot((int)i);
+        int c;
+        if (root==(int)i) {
+            c = (int)pComponent.size();
+            pComponent.push_back( { 0, r.x0, r.y, r.x1, r.y+1 } );
+        } else {
+            // roots come first, so their component exists already
+            c = pRunComponent[root];
+        }
+        pRunComponent[i] = c;
+        Component &cp = pComponent[c];
+        cp.pArea += r.x1-r.x0;
+        if (r.x0<cp.pXMin) cp.pXMin = r.x0;
+        if (r.x1>cp.pXMax) cp.pXMax = r.x1;
+        if (r.y+1>cp.pYMax) cp.pYMax = r.y+1;
+    }
+    sortRunsByComponent();
+    return (int)pComponent.size();
+}
+
+
+/**
+ * Group the run indices by component, so that every component can be
+ * drawn without looking at the runs of all other components.
+ */
+void IAComponentLabeler::sortRunsByComponent()
+{
+    pComponentRunStart.assign(pComponent.size()+1, 0);
+    for (int c: pRunComponent)
+        if (c>=0) pComponentRunStart[c+1]++;
+    for (size_t c=0; c<pComponent.size(); c++)
+        pComponentRunStart[c+1] += pComponentRunStart[c];
+    pComponentRun.resize(pComponentRunStart.back());
+    std::vector<int> fill(pComponentRunStart.begin(), pComponentRunStart.end()-1);
+    for (size_t i=0; i<pRun.size(); i++) {
+        int c = pRunComponent[i];
+        if (c>=0) pComponentRun[fill[c]++] = (int)i;
+    }
+}
+
+
+/**
+ * Draw the pixels of a single component into a bitmap.
+ *
+ * The bitmap must be cleared and large enough to hold the bounding box of
+ * the component. Pixels of other components are not drawn, even if they
+ * are inside the bounding box.
+ *
+ * \param c index of the component
+ * \param dst destination bitmap
+ * \param x0, y0 pixel position of the top left corner of dst
+ */
+void IAComponentLabeler::drawComponent(int c, potrace_bitmap_t *dst, int x0, int y0) const
+{
+    for (int k=pComponentRunStart[c]; k<pComponentRunStart[c+1]; k++) {
+        const Run &r = pRun[pComponentRun[k]];
+        bm_hline(dst, r.x0-x0, r.x1-x0, r.y-y0, 1);
+    }
+}
+
+
+/**
+ * Clear all components that are smaller than a given area.
+ *
+ * \param fb a BITMAP or TILED framebuffer that is not compressed
+ * \param minArea components with fewer pixels are removed
+ * \return the number of components that were kept
+ */
+int IAComponentLabeler::removeSmallComponents(IAFramebuffer *fb, long minArea)
+{
+    label(fb);
+    if (pComponent.empty()) return 0;
+
+    std::vector<int> newIndex(pComponent.size(), -1);
+    std::vector<Component> kept;
+    for (size_t c=0; c<pComponent.size(); c++) {
+        if (pComponent[c].pArea>=minArea) {
+            newIndex[c] = (int)kept.size();
+            kept.push_back(pComponent[c]);
+        }
+    }
+    if (kept.size()==pComponent.size()) return (int)kept.size();
+
+    fb->makeBitmapUnique();
+    for (size_t i=0; i<pRun.size(); i++) {
+        int c = newIndex[pRunComponent[i]];
+        if (c<0) {
+            const Run &r = pRun[i];
+            fb->hline(r.x0, r.x1, r.y, 0);
+        }
+        pRunComponent[i] = c;
+    }
+    pComponent.swap(kept);
+    sortRunsByComponent();
+    return (int)pComponent.size();
+}
+
@@ -0,0 +1,79 @@
+//
+//  IAComponentLabeler.h
+//
+//  Copyright (c) 2013-2018 Matthias Melcher. All rights reserved.
+//
+
+#ifndef IA_COMPONENT_LABELER_H
+#define IA_COMPONENT_LABELER_H
+
+
+#include "potrace/potracelib.h"
+
+#include <vector>
+
+
+class IAFramebuffer;
+
+
+/**
+ * Find the connected areas of set pixels in a bitmap.
+ *
+ * Scanlines are split into runs of set pixels a word at a time. Runs that
+ * touch a run in the previous scanline, including diagonally, are merged
+ * with a union-find structure. Every component knows its area and its
+ * bounding box.
+ *
+ * Small components are mostly slivers left over by infill patterns. They
+ * can be removed before tracing, so potrace does not have to trace them
+ * first and then throw them away.
+ */
+class IAComponentLabeler
+{
+public:
+    /** A connected area of set pixels. */
+    struct Component {
+        /** Number of set pixels */
+        long pArea;
+        /** Bounding box in pixels; pXMax and pYMax are one past the last pixel */
+        int pXMin, pYMin, pXMax, pYMax;
+    };
+
+    IAComponentLabeler();
+
+    int label(IAFramebuffer *fb);
+    int removeSmallComponents(IAFramebuffer *fb, long minArea);
+
+    /** All components that were found, or that were kept after removal. */
+    const std::vector<Component> &components() const { return pComponent; }
+
+    void drawComponent(int c, potrace_bitmap_t *dst, int x0, int y0) const;
+
+protected:
+    /** A horizontal run of set pixels; x1 is one past the last pixel. */
+    struct Run {
+        int x0, x1, y;
+        int parent;
+    };
+
+    int findRoot(int i);
+    void unite(int a, int b);
+    void addRuns(const potrace_word *row, int y, int width);
+    void sortRunsByComponent();
+
+    std::vector<Run> pRun;
+
+    /** Component index of every run, valid after label() */
+    std::vector<int> pRunComponent;
+
+    std::vector<Component> pComponent;
+
+    /** Indices of all runs, sorted by component */
+    std::vector<int> pComponentRun;
+
+    /** First entry in pComponentRun for every component, plus one entry at the end */
+    std::vector<int> pComponentRunStart;
+};
+
+
+#endif /* IA_COMPONENT_LABELER_H */
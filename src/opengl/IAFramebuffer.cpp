@@ -6,6 +6,11 @@
 
 
 #include "IAFramebuffer.h"
+#include "IATiledBitmap.h"
+#include "IASpanBitmap.h"
+#include "IAStripePattern.h"
+#include "IAMarchingSquares.h"
+#include "IAInfillLinker.h"
 
 #include "view/IAGUIMain.h"
 #include "toolpath/IAToolpath.h"
@@ -15,11 +20,23 @@
 
 #include <stdio.h>
 #include <math.h>
+#include <algorithm>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include <libjpeg/jpeglib.h>
 #include <libpng/png.h>
 #include <zlib.h>
 
 
+/** Components with fewer pixels are removed before tracing, see param->turdsize in IAPotrace.cpp */
+static const long kSpeckleArea = 20;
+
+/** RGBA pixels with a red component above this value are traced as set */
+static const uint8_t kTraceThreshold = 128;
+
+
 const char *glIAErrorString(int err)
 {
 #ifdef __APPLE__
@@ -141,7 +158,10 @@ IAFramebuffer::IAFramebuffer(IAPrinter *printer, Buffers buffers)
 :   pBuffers( buffers ),
     pPrinter( printer )
 {
-    // variables are initialized inline
+    if (printer) {
+        pWidth = printer->rasterWidth();
+        pHeight = printer->rasterHeight();
+    }
 }
 
 
@@ -154,22 +174,37 @@ IAFramebuffer::IAFramebuffer(IAFramebuffer *src)
 :   pBuffers( src->pBuffers ),
     pPrinter( src->pPrinter )
 {
-    if (src->hasFBO()) {
+    pWidth = src->pWidth;
+    pHeight = src->pHeight;
+    if (src->isCompressed()) {
+        // decode into an uncompressed buffer of the original type
         bindForRendering();
         if (pBuffers==BITMAP) {
-            /** \bug assuming that all framebuffers have the same resolution */
-            pBitmap = bm_dup(src->pBitmap);
+            for (int y=0; y<pHeight; y++)
+                src->pSpanBitmap->decodeRow(y, bm_scanline(pBitmap, y));
         } else {
-            glBindFramebufferEXT(GL_READ_FRAMEBUFFER, src->pFramebuffer);
-            IA_HANDLE_GL_ERRORS();
-            glBindFramebufferEXT(GL_DRAW_FRAMEBUFFER, pFramebuffer);
-            IA_HANDLE_GL_ERRORS();
-            glBlitFramebufferEXT(0, 0, pWidth, pHeight,
-                                 0, 0, pWidth, pHeight,
-                                 GL_COLOR_BUFFER_BIT, GL_NEAREST);
-            IA_HANDLE_GL_ERRORS();
+            fill(1);
+            logicAndSpans(src->pSpanBitmap, false);
         }
         unbindFromRendering();
+    } else if (src->hasFBO() && src->isBitmap()) {
+        // share the pixels; the first buffer that is modified makes a copy
+        pBitmapRef = src->pBitmapRef;
+        pBitmap = src->pBitmap;
+        pTiledBitmapRef = src->pTiledBitmapRef;
+        pTiledBitmap = src->pTiledBitmap;
+        pFramebufferCreated = true;
+    } else if (src->hasFBO()) {
+        bindForRendering();
+        glBindFramebufferEXT(GL_READ_FRAMEBUFFER, src->pFramebuffer);
+        IA_HANDLE_GL_ERRORS();
+        glBindFramebufferEXT(GL_DRAW_FRAMEBUFFER, pFramebuffer);
+        IA_HANDLE_GL_ERRORS();
+        glBlitFramebufferEXT(0, 0, pWidth, pHeight,
+                             0, 0, pWidth, pHeight,
+                             GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        IA_HANDLE_GL_ERRORS();
+        unbindFromRendering();
     }
 }
 
@@ -182,7 +217,11 @@ IAFramebuffer::IAFramebuffer(IAFramebuffer *src)
  */
 void IAFramebuffer::logicAndNot(IAFramebuffer *src)
 {
-    if (src && src->hasFBO()) {
+    if (src && src->isCompressed()) {
+        bindForRendering();
+        logicAndSpans(src->pSpanBitmap, true);
+        unbindFromRendering();
+    } else if (src && src->hasFBO()) {
         bindForRendering();
         if (pBuffers==BITMAP) {
             int dy = pBitmap->dy;
@@ -192,13 +231,28 @@ void IAFramebuffer::logicAndNot(IAFramebuffer *src)
             if (dy < 0) {
                 dy = -dy;
             }
+            potrace_bitmap_t *srcBitmap = src->pBitmap;
+            if (src->pTiledBitmap) {
+                srcBitmap = bm_new(pWidth, pHeight);
+                src->pTiledBitmap->copyToBitmap(srcBitmap, 0, 0);
+            }
             for (y=0; y < pBitmap->h; y++) {
-                pSrc = bm_scanline(src->pBitmap, y);
+                pSrc = bm_scanline(srcBitmap, y);
                 pDst = bm_scanline(pBitmap, y);
                 for (i=0; i < dy; i++) {
                     pDst[i] = pDst[i] & ~pSrc[i];
                 }
             }
+            if (srcBitmap!=src->pBitmap)
+                bm_free(srcBitmap);
+        } else if (pBuffers==TILED) {
+            if (src->pTiledBitmap) {
+                pTiledBitmap->logicAndNot(*src->pTiledBitmap);
+            } else {
+                IATiledBitmap tmp(pWidth, pHeight);
+                tmp.copyFromBitmap(src->pBitmap);
+                pTiledBitmap->logicAndNot(tmp);
+            }
         } else {
             glBindFramebufferEXT(GL_READ_FRAMEBUFFER, src->pFramebuffer);
             IA_HANDLE_GL_ERRORS();
@@ -252,7 +306,11 @@ void IAFramebuffer::logicAndNot(IAFramebuffer *src)
  */
 void IAFramebuffer::logicAnd(IAFramebuffer *src)
 {
-    if (src && src->hasFBO()) {
+    if (src && src->isCompressed()) {
+        bindForRendering();
+        logicAndSpans(src->pSpanBitmap, false);
+        unbindFromRendering();
+    } else if (src && src->hasFBO()) {
         bindForRendering();
         if (pBuffers==BITMAP) {
             int dy = pBitmap->dy;
@@ -262,13 +320,28 @@ void IAFramebuffer::logicAnd(IAFramebuffer *src)
             if (dy < 0) {
                 dy = -dy;
             }
+            potrace_bitmap_t *srcBitmap = src->pBitmap;
+            if (src->pTiledBitmap) {
+                srcBitmap = bm_new(pWidth, pHeight);
+                src->pTiledBitmap->copyToBitmap(srcBitmap, 0, 0);
+            }
             for (y=0; y < pBitmap->h; y++) {
-                pSrc = bm_scanline(src->pBitmap, y);
+                pSrc = bm_scanline(srcBitmap, y);
                 pDst = bm_scanline(pBitmap, y);
                 for (i=0; i < dy; i++) {
                     pDst[i] = pDst[i] & pSrc[i];
                 }
             }
+            if (srcBitmap!=src->pBitmap)
+                bm_free(srcBitmap);
+        } else if (pBuffers==TILED) {
+            if (src->pTiledBitmap) {
+                pTiledBitmap->logicAnd(*src->pTiledBitmap);
+            } else {
+                IATiledBitmap tmp(pWidth, pHeight);
+                tmp.copyFromBitmap(src->pBitmap);
+                pTiledBitmap->logicAnd(tmp);
+            }
         } else {
             glBindFramebufferEXT(GL_READ_FRAMEBUFFER, src->pFramebuffer);
             IA_HANDLE_GL_ERRORS();
@@ -316,14 +389,384 @@ void IAFramebuffer::logicAnd(IAFramebuffer *src)
 
 
 /**
- * Delete the framebuffer, if we ever created one.
+ * Compress a bitmap that will only be read from now on.
+ *
+ * The pixels are encoded as spans of set pixels per row and the bitmap
+ * memory is released. A compressed buffer can still be used as the source
+ * of a copy or a logic operation, which decode the spans directly. Drawing
+ * into it will expand it again.
  */
-IAFramebuffer::~IAFramebuffer()
+void IAFramebuffer::compress()
+{
+    if (!isBitmap() || !hasFBO() || pSpanBitmap)
+        return;
+    pSpanBitmap = new IASpanBitmap(pWidth, pHeight);
+    pSpanBitmap->beginEncoding();
+    if (pBitmap) {
+        for (int y=0; y<pHeight; y++)
+            pSpanBitmap->encodeRow(y, bm_scanline(pBitmap, y));
+    } else {
+        // read the tiles one scanline at a time
+        potrace_bitmap_t *row = bm_new(pWidth, 1);
+        for (int y=0; y<pHeight; y++) {
+            pTiledBitmap->copyToBitmap(row, 0, y);
+            pSpanBitmap->encodeRow(y, bm_scanline(row, 0));
+        }
+        bm_free(row);
+    }
+    releaseBitmap();
+    pSpanBitmap->endEncoding();
+}
+
+
+/**
+ * Decode a compressed bitmap so that it can be modified again.
+ */
+void IAFramebuffer::expand()
+{
+    if (!pSpanBitmap)
+        return;
+    IASpanBitmap *spans = pSpanBitmap;
+    pSpanBitmap = nullptr;
+    newBitmap();
+    if (pBuffers==BITMAP) {
+        for (int y=0; y<pHeight; y++)
+            spans->decodeRow(y, bm_scanline(pBitmap, y));
+    } else {
+        pTiledBitmap->fill(1);
+        logicAndSpans(spans, false);
+        pTiledBitmap->compact();
+    }
+    delete spans;
+}
+
+
+/**
+ * Read one scanline of a BITMAP or TILED buffer, compressed or not.
+ *
+ * \param y row number
+ * \param dst receives one potrace scanline; all zeros if there is no bitmap
+ */
+void IAFramebuffer::readRow(int y, potrace_word *dst)
+{
+    int nWords = (pWidth+BM_WORDBITS-1)/BM_WORDBITS;
+    if (pSpanBitmap) {
+        pSpanBitmap->decodeRow(y, dst);
+    } else if (pBitmap) {
+        memcpy(dst, bm_scanline(pBitmap, y), nWords*sizeof(potrace_word));
+    } else if (pTiledBitmap) {
+        potrace_bitmap_t row = { pWidth, 1, nWords, dst };
+        pTiledBitmap->copyToBitmap(&row, 0, y);
+    } else {
+        memset(dst, 0, nWords*sizeof(potrace_word));
+    }
+}
+
+
+/**
+ * Copy w bits, starting at bit x0 of a scanline, to the start of another scanline.
+ *
+ * Bits past the end of the source and past w are cleared.
+ */
+static void copyBits(const potrace_word *src, int srcWords, int x0, potrace_word *dst, int w)
+{
+    int dstWords = (w+BM_WORDBITS-1)/BM_WORDBITS;
+    int k = x0/BM_WORDBITS, sh = x0%BM_WORDBITS;
+    for (int i=0; i<dstWords; i++, k++) {
+        potrace_word v = (k<srcWords) ? src[k]<<sh : 0;
+        if (sh && k+1<srcWords) v |= src[k+1]>>(BM_WORDBITS-sh);
+        dst[i] = v;
+    }
+    int lastBits = w%BM_WORDBITS;
+    if (lastBits) dst[dstWords-1] &= ~(BM_ALLBITS>>lastBits);
+}
+
+
+/**
+ * Set a bit for every RGBA pixel whose red component is above kTraceThreshold.
+ *
+ * This runs for every pixel of a layer. With SSE2, four pixels are compared
+ * with a single instruction and their results are gathered with movemask.
+ *
+ * \param rgba w pixels, four bytes each
+ * \param w number of pixels
+ * \param dst a cleared potrace scanline
+ */
+static void packRow(const uint8_t *rgba, int w, potrace_word *dst)
+{
+    int x = 0;
+#if defined(__SSE2__)
+    // movemask puts the first pixel into the lowest bit, potrace wants it first
+    static const uint8_t reverse4[16] = {
+        0x0, 0x8, 0x4, 0xC, 0x2, 0xA, 0x6, 0xE, 0x1, 0x9, 0x5, 0xD, 0x3, 0xB, 0x7, 0xF };
+    const __m128i sign = _mm_set1_epi8((char)0x80);
+    const __m128i threshold = _mm_set1_epi8((char)(kTraceThreshold^0x80));
+    for ( ; x+4<=w; x+=4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(rgba+x*4));
+        // bytes are unsigned, so flip the sign bit before the signed compare
+        __m128i gt = _mm_cmpgt_epi8(_mm_xor_si128(v, sign), threshold);
+        // move the result of the red byte into the sign bit of each pixel
+        int m = _mm_movemask_ps(_mm_castsi128_ps(_mm_slli_epi32(gt, 24)));
+        int shift = BM_WORDBITS-4-(x%BM_WORDBITS);
+        dst[x/BM_WORDBITS] |= (potrace_word)reverse4[m] << shift;
+    }
+#endif
+    for ( ; x<w; x++) {
+        if (rgba[x*4]>kTraceThreshold)
+            dst[x/BM_WORDBITS] |= bm_mask(x);
+    }
+}
+
+
+/**
+ * Find the rectangle that contains all set pixels.
+ *
+ * TILED buffers check their tiles, BITMAP buffers check every word. RGBA
+ * buffers are not searched and return the entire buffer.
+ *
+ * \param[out] x0, y0 first pixel of the area
+ * \param[out] x1, y1 last pixel of the area plus one
+ *
+ * \return false if there are no pixels to trace
+ */
+bool IAFramebuffer::contentBounds(int &x0, int &y0, int &x1, int &y1)
+{
+    if (pTiledBitmap && !pSpanBitmap)
+        return pTiledBitmap->contentBounds(x0, y0, x1, y1);
+    if (pWidth==0 || pHeight==0)
+        return false;
+    if (!isBitmap()) {
+        x0 = 0; y0 = 0; x1 = pWidth; y1 = pHeight;
+        return true;
+    }
+    int nWords = (pWidth+BM_WORDBITS-1)/BM_WORDBITS;
+    std::vector<potrace_word> row(nWords), any(nWords, 0);
+    y0 = -1;
+    for (int y=0; y<pHeight; y++) {
+        readRow(y, row.data());
+        bool set = false;
+        for (int i=0; i<nWords; i++) {
+            if (row[i]) {
+                any[i] |= row[i];
+                set = true;
+            }
+        }
+        if (set) {
+            if (y0<0) y0 = y;
+            y1 = y+1;
+        }
+    }
+    if (y0<0) return false;
+    x0 = 0;
+    while (!(any[x0/BM_WORDBITS] & bm_mask(x0))) x0++;
+    x1 = nWords*BM_WORDBITS;
+    while (!(any[(x1-1)/BM_WORDBITS] & bm_mask(x1-1))) x1--;
+    if (x1>pWidth) x1 = pWidth;
+    return x0<x1;
+}
+
+
+/**
+ * Copy a rectangle of pixels into a potrace bitmap.
+ *
+ * BITMAP and TILED buffers are copied, compressed or not. RGBA buffers are
+ * thresholded at their red component.
+ *
+ * \param dst destination bitmap; its size defines the size of the rectangle
+ * \param x0, y0 position of the rectangle in this buffer, must not be negative
+ */
+void IAFramebuffer::copyToBitmap(potrace_bitmap_t *dst, int x0, int y0)
+{
+    if (pTiledBitmap && !pSpanBitmap) {
+        pTiledBitmap->copyToBitmap(dst, x0, y0);
+        return;
+    }
+    int nWords = (pWidth+BM_WORDBITS-1)/BM_WORDBITS;
+    std::vector<potrace_word> row;
+    const uint8_t *rgba = nullptr;
+    uint8_t *rgbaCopy = nullptr;
+    if (isBitmap()) {
+        row.resize(nWords);
+    } else {
+        rgba = rgbaCopy = getRawImageRGBA();
+    }
+    for (int y=0; y<dst->h; y++) {
+        potrace_word *d = bm_scanline(dst, y);
+        int sy = y+y0;
+        if (sy>=pHeight) {
+            memset(d, 0, dst->dy*sizeof(potrace_word));
+        } else if (pBitmap && !pSpanBitmap) {
+            copyBits(bm_scanline(pBitmap, sy), nWords, x0, d, dst->w);
+        } else if (isBitmap()) {
+            readRow(sy, row.data());
+            copyBits(row.data(), nWords, x0, d, dst->w);
+        } else {
+            int w = std::min(dst->w, pWidth-x0);
+            memset(d, 0, dst->dy*sizeof(potrace_word));
+            packRow(rgba + ((size_t)sy*pWidth + x0)*4, std::max(w, 0), d);
+        }
+    }
+    ::free(rgbaCopy);
+}
+
+
+/**
+ * Remove all connected areas of set pixels that are smaller than a given area.
+ *
+ * Infill and lid patterns leave many tiny slivers at the edges of a layer.
+ * They are too small to be printed, and removing them here is much cheaper
+ * than tracing them.
+ *
+ * \param minArea smaller components are removed, in pixels
+ * \param labeler if not nullptr, this labeler is used and keeps all
+ *      components that were not removed
+ * \return the number of components that were kept
+ */
+int IAFramebuffer::removeSpeckles(long minArea, IAComponentLabeler *labeler)
+{
+    if (!isBitmap() || !hasFBO())
+        return 0;
+    expand();
+    IAComponentLabeler localLabeler;
+    if (!labeler) labeler = &localLabeler;
+    int n = labeler->removeSmallComponents(this, minArea);
+    if (pTiledBitmap)
+        pTiledBitmap->compact();
+    return n;
+}
+
+
+/**
+ * Follow a change in the raster resolution of the printer.
+ *
+ * If the size changed, all pixels are released, and the buffer will be
+ * created again in the new size when it is drawn into.
+ */
+void IAFramebuffer::updateSize()
+{
+    if (pPrinter)
+        setSize(pPrinter->rasterWidth(), pPrinter->rasterHeight());
+}
+
+
+/**
+ * Change the resolution of the framebuffer.
+ *
+ * The buffer still covers the entire print volume, so fewer pixels mean
+ * larger pixels. If the size changed, all pixels are released.
+ *
+ * \param w, h new size in pixels
+ */
+void IAFramebuffer::setSize(int w, int h)
+{
+    if (w==pWidth && h==pHeight)
+        return;
+    if (hasFBO())
+        deleteFBO();
+    delete pSpanBitmap;
+    pSpanBitmap = nullptr;
+    pWidth = w;
+    pHeight = h;
+}
+
+
+/**
+ * Logic AND or AND NOT a span encoded bitmap onto this bitmap, row by row.
+ *
+ * \param src the compressed source bitmap
+ * \param invert if set, clear all pixels that are set in src
+ */
+void IAFramebuffer::logicAndSpans(IASpanBitmap *src, bool invert)
 {
     if (pBitmap) {
-        bm_free(pBitmap);
-        pBitmap = nullptr;
+        for (int y=0; y<pHeight; y++) {
+            if (invert)
+                src->andNotRow(y, bm_scanline(pBitmap, y));
+            else
+                src->andRow(y, bm_scanline(pBitmap, y));
+        }
+    } else if (pTiledBitmap) {
+        int nWords = (pWidth+BM_WORDBITS-1)/BM_WORDBITS;
+        potrace_word *mask = (potrace_word*)::malloc(nWords*sizeof(potrace_word));
+        for (int y=0; y<pHeight; y++) {
+            src->decodeRow(y, mask);
+            if (invert) {
+                for (int i=0; i<nWords; i++) mask[i] = ~mask[i];
+            }
+            pTiledBitmap->andRow(y, mask);
+        }
+        ::free((void*)mask);
+    }
+}
+
+
+/**
+ * Allocate unshared pixel memory for BITMAP and TILED buffers.
+ *
+ * Flat bitmaps come from the bitmap pool and their content is undefined.
+ */
+void IAFramebuffer::newBitmap()
+{
+    releaseBitmap();
+    if (pBuffers==BITMAP) {
+        pBitmapRef = IABitmapPool::acquire(pWidth, pHeight);
+        pBitmap = pBitmapRef.get();
+    } else if (pBuffers==TILED) {
+        pTiledBitmapRef = std::make_shared<IATiledBitmap>(pWidth, pHeight);
+        pTiledBitmap = pTiledBitmapRef.get();
     }
+}
+
+
+/**
+ * Let go of the pixel memory; it is recycled when no other buffer uses it.
+ */
+void IAFramebuffer::releaseBitmap()
+{
+    pBitmapRef = nullptr;
+    pBitmap = nullptr;
+    pTiledBitmapRef = nullptr;
+    pTiledBitmap = nullptr;
+}
+
+
+/**
+ * Return true if another framebuffer shares our pixel memory.
+ */
+bool IAFramebuffer::isBitmapShared()
+{
+    return (pBitmapRef && pBitmapRef.use_count()>1)
+        || (pTiledBitmapRef && pTiledBitmapRef.use_count()>1);
+}
+
+
+/**
+ * Copy shared pixel memory, so that we can modify it.
+ */
+void IAFramebuffer::makeBitmapUnique()
+{
+    if (!isBitmapShared())
+        return;
+    if (pBitmapRef) {
+        IABitmapSP bm = IABitmapPool::acquire(pWidth, pHeight);
+        memcpy(bm_base(bm.get()), bm_base(pBitmap), bm_size(pBitmap));
+        pBitmapRef = bm;
+        pBitmap = bm.get();
+    } else {
+        pTiledBitmapRef = std::make_shared<IATiledBitmap>(*pTiledBitmap);
+        pTiledBitmap = pTiledBitmapRef.get();
+    }
+}
+
+
+/**
+ * Delete the framebuffer, if we ever created one.
+ */
+IAFramebuffer::~IAFramebuffer()
+{
+    releaseBitmap();
+    delete pSpanBitmap;
+    pSpanBitmap = nullptr;
     if (hasFBO()) {
         deleteFBO();
         pFramebufferCreated = false;
@@ -339,6 +782,9 @@ IAFramebuffer::~IAFramebuffer()
 void IAFramebuffer::fill(int color)
 {
     if (hasFBO()) {
+        // no need to copy shared pixels that will be overwritten anyway
+        if (isBitmapShared())
+            newBitmap();
         bindForRendering();
         if (pBuffers==RGBA) {
             glClearColor(0.0, 0.0, 0.0, 0.0);
@@ -349,6 +795,8 @@ void IAFramebuffer::fill(int color)
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         } else if (pBuffers==BITMAP) {
             bm_clear(pBitmap, color);
+        } else if (pBuffers==TILED) {
+            pTiledBitmap->fill(color);
         }
         unbindFromRendering();
     }
@@ -362,7 +810,7 @@ void IAFramebuffer::bindForRendering()
 {
     activateFBO();
 
-    if (pBuffers==BITMAP) {
+    if (isBitmap()) {
         // nothing to do
     } else {
         // set matrices, lighting, etc. for this FBO
@@ -395,7 +843,10 @@ void IAFramebuffer::bindForRendering()
  */
 void IAFramebuffer::unbindFromRendering()
 {
-    if (pBuffers==BITMAP) {
+    if (pBuffers==TILED) {
+        // tiles that became uniform while drawing no longer need pixel memory
+        pTiledBitmap->compact();
+    } else if (pBuffers==BITMAP) {
         // nothing to do
     } else {
         // deactivate the FBO and set render target to FL_BACKBUFFER
@@ -417,11 +868,13 @@ uint8_t *IAFramebuffer::getRawImageRGB()
 {
     size_t size = pWidth*pHeight*3;
     uint8_t *data = (uint8_t*)calloc(size, 1);
-    if (pBuffers==BITMAP) {
+    if (isBitmap()) {
+        expand();
         uint8_t *dst = data;
         for (int y=0; y<pHeight; y++) {
             for (int x=0; x<pWidth; x++) {
-                uint8_t lum = BM_UGET(pBitmap, x, y) ? 255 : 0;
+                bool set = pTiledBitmap ? pTiledBitmap->get(x, y) : BM_UGET(pBitmap, x, y);
+                uint8_t lum = set ? 255 : 0;
                 *dst++ = lum;
                 *dst++ = lum;
                 *dst++ = lum;
@@ -449,11 +902,13 @@ uint8_t *IAFramebuffer::getRawImageRGBA()
 {
     size_t size = pWidth*pHeight*4;
     uint8_t *data = (uint8_t*)calloc(size, 1);
-    if (pBuffers==BITMAP) {
+    if (isBitmap()) {
+        expand();
         uint8_t *dst = data;
         for (int y=0; y<pHeight; y++) {
             for (int x=0; x<pWidth; x++) {
-                uint8_t lum = BM_UGET(pBitmap, x, y) ? 255 : 0;
+                bool set = pTiledBitmap ? pTiledBitmap->get(x, y) : BM_UGET(pBitmap, x, y);
+                uint8_t lum = set ? 255 : 0;
                 *dst++ = lum;
                 *dst++ = lum;
                 *dst++ = lum;
@@ -477,14 +932,29 @@ uint8_t *IAFramebuffer::getRawImageRGBA()
  *
  * \param toolpath add outline segments to this toolpath
  * \param z give all segments in the toolpath a z position
+ * \param tracer fit curves with potrace, or use straight segments from
+ *      IAMarchingSquares, simplified to IAPrinter::traceTolerance
  *
  * \return returns 0 on success
  */
-int IAFramebuffer::traceOutline(IAToolpathList *toolpathList, double z)
+int IAFramebuffer::traceOutline(IAToolpathList *toolpathList, double z, Tracer tracer)
 {
     toolpathList->purge();
     toolpathList->setZ(z);
-    potrace(this, toolpathList, z);
+    if (tracer==MARCHING_SQUARES) {
+        if (isBitmap()) removeSpeckles(kSpeckleArea);
+        double xScl = pPrinter->pPrintVolume.x()/pWidth;
+        double yScl = pPrinter->pPrintVolume.y()/pHeight;
+        IAMarchingSquares ms(pPrinter->traceTolerance()/xScl);
+        ms.trace(this, toolpathList, z, xScl, yScl);
+    } else if (pBitmap || pTiledBitmap) {
+        // potrace would drop these only after tracing them
+        IAComponentLabeler labeler;
+        removeSpeckles(kSpeckleArea, &labeler);
+        potrace(this, toolpathList, z, &labeler);
+    } else {
+        potrace(this, toolpathList, z);
+    }
     return 0;
 }
 
@@ -655,7 +1125,7 @@ void IAFramebuffer::draw(double z)
 {
     if (!hasFBO()) return;
 
-    if (pBuffers==BITMAP) {
+    if (isBitmap()) {
         /** \bug write this */
     } else {
         // set as texture and render out
@@ -699,8 +1169,12 @@ void IAFramebuffer::activateFBO()
     if (!pFramebufferCreated) {
         createFBO();
     }
-    if (pBuffers==BITMAP) {
-        // nothing to do
+    if (pSpanBitmap) {
+        expand();
+    }
+    if (isBitmap()) {
+        // we are about to modify pixels that may be shared with a copy
+        makeBitmapUnique();
     } else {
         /** \todo what if there was an error and FBO is still not created */
         IA_HANDLE_GL_ERRORS();
@@ -721,8 +1195,8 @@ void IAFramebuffer::createFBO()
 {
     // Create this thing
 
-    if (pBuffers==BITMAP) {
-        pBitmap = bm_new(pWidth, pHeight);
+    if (isBitmap()) {
+        newBitmap();
     } else {
         //RGBA8 2D texture, 24 bit depth texture
         IA_HANDLE_GL_ERRORS();
@@ -785,8 +1259,8 @@ void IAFramebuffer::createFBO()
  */
 void IAFramebuffer::deleteFBO()
 {
-    if (pBuffers==BITMAP) {
-        bm_free(pBitmap);
+    if (isBitmap()) {
+        releaseBitmap();
     } else {
         //Bind 0, which means render to back buffer, as a result, fb is unbound
         IA_HANDLE_GL_ERRORS();
@@ -811,17 +1285,18 @@ void IAFramebuffer::deleteFBO()
  * Trace the framebuffer and create a toolpath.
  *
  * \param z create a toolptah at this layer
+ * \param tracer see traceOutline()
  *
  * \return nullptr, if tracing generates an empty toolpath
  * \return a new smart_pointer to a toolpath
  */
-IAToolpathListSP IAFramebuffer::toolpathFromLasso(double z)
+IAToolpathListSP IAFramebuffer::toolpathFromLasso(double z, Tracer tracer)
 {
     // use a shared pointer, so we don't have to worry about deallocating
     auto tp0 = std::make_shared<IAToolpathList>(z);
 
     // create an outline for this slice image
-    traceOutline(tp0.get(), z);
+    traceOutline(tp0.get(), z, tracer);
 
     if (tp0->isEmpty())
         return nullptr;
@@ -836,14 +1311,15 @@ IAToolpathListSP IAFramebuffer::toolpathFromLasso(double z)
  *
  * \param z create a toolpath at this layer
  * \param r the pattern will be reduced by the amount in r
+ * \param tracer see traceOutline()
  *
  * \return nullptr, if tracing generates an empty toolpath
  * \return a new smart_pointer to a toolpath
  */
-IAToolpathListSP IAFramebuffer::toolpathFromLassoAndContract(double z, double r)
+IAToolpathListSP IAFramebuffer::toolpathFromLassoAndContract(double z, double r, Tracer tracer)
 {
     // use a shared pointer, so we don;t have to worry about deallocating
-    auto tp0 = toolpathFromLasso(z);
+    auto tp0 = toolpathFromLasso(z, tracer);
     subtract(tp0, r);
     return tp0;
 }
@@ -855,14 +1331,15 @@ IAToolpathListSP IAFramebuffer::toolpathFromLassoAndContract(double z, double r)
  *
  * \param z create a toolpath at this layer
  * \param r the pattern will be increased by the amount in r
+ * \param tracer see traceOutline()
  *
  * \return nullptr, if tracing generates an empty toolpath
  * \return a new smart_pointer to a toolpath
  */
-IAToolpathListSP IAFramebuffer::toolpathFromLassoAndExpand(double z, double r)
+IAToolpathListSP IAFramebuffer::toolpathFromLassoAndExpand(double z, double r, Tracer tracer)
 {
     // use a shared pointer, so we don;t have to worry about deallocating
-    auto tp0 = toolpathFromLasso(z);
+    auto tp0 = toolpathFromLasso(z, tracer);
     add(tp0, r);
     return tp0;
 }
@@ -879,7 +1356,7 @@ void IAFramebuffer::subtract(IAToolpathListSP tp, double r)
     if (tp) {
         // draw the outline to contract the image
         bindForRendering();
-        if (pBuffers==BITMAP) {
+        if (isBitmap()) {
             tp->drawFlatToBitmap(this, r*2.0);
         } else {
             glDisable(GL_DEPTH_TEST);
@@ -902,7 +1379,7 @@ void IAFramebuffer::add(IAToolpathListSP tp, double r)
     if (tp) {
         // draw the outline to contract the image
         bindForRendering();
-        if (pBuffers==BITMAP) {
+        if (isBitmap()) {
             tp->drawFlatToBitmap(this, r*2.0, 1);
         } else {
             glDisable(GL_DEPTH_TEST);
@@ -928,23 +1405,13 @@ void IAFramebuffer::overlayLidPattern(int i, double infillWdt)
     /** \todo What if the printer has negative coordintes as well? */
     double wdt = pPrinter->printVolumeMax().x();
     double hgt = pPrinter->printVolumeMax().y();
-    if (pBuffers==BITMAP) {
+    if (isBitmap()) {
         if (i&1) {
-            int dx = infillWdt/pPrinter->pPrintVolume.x()*pWidth;
-            if (dx<1) dx = 1;
-            for (int x=0; x<pWidth; x+=2*dx) {
-                for (int y=0; y<pHeight; y++) {
-                    bm_hline(pBitmap, x, x+dx, y, 0);
-                }
-            }
+            double dx = infillWdt/pPrinter->pPrintVolume.x()*pWidth;
+            overlayPattern(IAStripePattern(2*dx, dx, 90.0));
         } else {
-            int dy = infillWdt/pPrinter->pPrintVolume.y()*pHeight;
-            if (dy<1) dy = 1;
-            for (int y1=0; y1<pHeight; y1+=2*dy) {
-                for (int y2=0; y2<dy; y2++) {
-                    bm_hline(pBitmap, 0, pWidth, y1+y2, 0);
-                }
-            }
+            double dy = infillWdt/pPrinter->pPrintVolume.y()*pHeight;
+            overlayPattern(IAStripePattern(2*dy, dy, 0.0));
         }
     } else {
         glDisable(GL_DEPTH_TEST);
@@ -968,6 +1435,38 @@ void IAFramebuffer::overlayLidPattern(int i, double infillWdt)
 }
 
 
+/**
+ * Fill the image with diagonal zigzag lines.
+ *
+ * This creates the same lines as tracing the image after
+ * overlayInfillPattern(), but neighboring lines are linked along the
+ * outline wherever possible, so the head does not have to travel and
+ * retract between them. The image is not changed, except for removing
+ * speckles.
+ *
+ * \param z create a toolpath at this layer
+ * \param i determines if the lines are ascending or descending
+ * \param infillWdt distance between lines
+ *
+ * \return nullptr, if there are no lines
+ * \return a new smart_pointer to a toolpath
+ */
+IAToolpathListSP IAFramebuffer::toolpathFromZigzag(double z, int i, double infillWdt)
+{
+    auto tp0 = std::make_shared<IAToolpathList>(z);
+    tp0->setZ(z);
+    if (isBitmap()) removeSpeckles(kSpeckleArea);
+    double xScl = pPrinter->pPrintVolume.x()/pWidth;
+    double yScl = pPrinter->pPrintVolume.y()/pHeight;
+    IAInfillLinker linker(infillWdt/xScl, (i&1)!=0);
+    linker.link(this, tp0.get(), z, xScl, yScl);
+    if (tp0->isEmpty())
+        return nullptr;
+    else
+        return tp0;
+}
+
+
 /**
  * Overlay the image with diagonal alternating stripes.
  *
@@ -978,41 +1477,10 @@ void IAFramebuffer::overlayLidPattern(int i, double infillWdt)
 void IAFramebuffer::overlayInfillPattern(int i, double infillWdt)
 {
     bindForRendering();
-    if (pBuffers==BITMAP) {
-        infillWdt *= sqrt(2.0); // compensate that we draw at a 45 deg angle
-        int dx = infillWdt/pPrinter->pPrintVolume.x()*pWidth;
-        if (dx<1) dx = 1;
-        if (dx==10) {
-            /// \todo some ultra fast fill function using word sized lookup tables
-            // This is a special case for dx=10, just to try the effect
-            bm_word m = 0b1111111111000000000011111111110000000000111111111100000000001111;
-            bm_word lut[20];
-            for (int i=0; i<20; i++) lut[i] = (m>>i) | (m<<(20-i));
-            for (int y=0; y<pHeight; y++) {
-                bm_word *dst = bm_scanline(pBitmap, y);
-                int src = (i&1) ? y%20 : 19-(y%20);
-                for (int x=0; x<pBitmap->dy; x++) {
-                    *dst++ &= lut[src];
-                    src = (src+16)%20;
-                }
-            }
-        } else {
-            if (i&1) {
-                for (int y=0; y<pHeight; y++) {
-                    for (int x=0; x<pWidth; x+=2*dx) {
-                        int xx = x + y%(2*dx);
-                        bm_hline(pBitmap, xx, xx+dx, y, 0);
-                    }
-                }
-            } else {
-                for (int y=0; y<pHeight; y++) {
-                    for (int x=0; x<pWidth; x+=2*dx) {
-                        int xx = x+2*dx - y%(2*dx);
-                        bm_hline(pBitmap, xx, xx+dx, y, 0);
-                    }
-                }
-            }
-        }
+    if (isBitmap()) {
+        // stripes at 45 deg, ascending or descending
+        double dx = infillWdt/pPrinter->pPrintVolume.x()*pWidth;
+        overlayPattern(IAStripePattern(2*dx, dx, (i&1) ? 45.0 : -45.0));
     } else {
         glDisable(GL_DEPTH_TEST);
         glColor3f(0.0, 0.0, 0.0);
@@ -1079,44 +1547,18 @@ void IAFramebuffer::endComplexPolygon(int color)
     }
     xMax++; yMax++;
 
-    int nodes, pixelY, i, j, swap;
+    int nodes, pixelY, i;
 	int *nodeX = (int*)::malloc((end - begin) * sizeof(int));
 
+    if (pTiledBitmap) {
+        fillTiledPolygon(color, xMin, xMax, yMin, yMax, nodeX);
+        ::free((void*)nodeX);
+        return;
+    }
+
     //  Loop through the rows of the image.
     for (pixelY = yMin; pixelY < yMax; pixelY++) {
-        //  Build a list of nodes.
-        nodes = 0;
-        for (i = begin+1; i < end; i++) {
-            j = i-1;
-            if (pVertex[j].pIsGap)
-                continue;
-            if (   (pVertex[i].pY < pixelY && pVertex[j].pY >= pixelY)
-                || (pVertex[j].pY < pixelY && pVertex[i].pY >= pixelY) )
-            {
-                float dy = pVertex[j].pY - pVertex[i].pY;
-                if (fabsf(dy)>.0001) {
-                    nodeX[nodes++] = (int)(pVertex[i].pX +
-                                           (pixelY - pVertex[i].pY) / dy
-                                           * (pVertex[j].pX - pVertex[i].pX));
-                } else {
-                    nodeX[nodes++] = pVertex[i].pX;
-                }
-            }
-        }
-        //Fl_Android_Application::log_e("%d nodes (must be even!)", nodes);
-
-        //  Sort the nodes, via a simple “Bubble” sort.
-        i = 0;
-        while (i < nodes - 1) {
-            if (nodeX[i] > nodeX[i + 1]) {
-                swap = nodeX[i];
-                nodeX[i] = nodeX[i + 1];
-                nodeX[i + 1] = swap;
-                if (i) i--;
-            } else {
-                i++;
-            }
-        }
+        nodes = scanlineNodes(pixelY, nodeX);
 
         //  Fill the pixels between node pairs.
         for (i = 0; i < nodes-1; i += 2) {
@@ -1124,7 +1566,7 @@ void IAFramebuffer::endComplexPolygon(int color)
             if (nodeX[i + 1] > xMin) {
                 if (nodeX[i] < xMin) nodeX[i] = xMin;
                 if (nodeX[i + 1] > xMax) nodeX[i + 1] = xMax;
-                bm_hline(pBitmap, nodeX[i], nodeX[i+1], pixelY, color);
+                hline(nodeX[i], nodeX[i+1], pixelY, color);
             }
         }
     }
@@ -1132,6 +1574,197 @@ void IAFramebuffer::endComplexPolygon(int color)
 }
 
 
+/**
+ * Find all crossings of the polygon outline with a scanline.
+ *
+ * \param pixelY the scanline
+ * \param nodeX receives the x coordinates of all crossings, sorted
+ * \return the number of crossings
+ */
+int IAFramebuffer::scanlineNodes(int pixelY, int *nodeX)
+{
+    int nodes = 0, i, j, swap;
+    for (i = 1; i < pnVertex; i++) {
+        j = i-1;
+        if (pVertex[j].pIsGap)
+            continue;
+        if (   (pVertex[i].pY < pixelY && pVertex[j].pY >= pixelY)
+            || (pVertex[j].pY < pixelY && pVertex[i].pY >= pixelY) )
+        {
+            float dy = pVertex[j].pY - pVertex[i].pY;
+            if (fabsf(dy)>.0001) {
+                nodeX[nodes++] = (int)(pVertex[i].pX +
+                                       (pixelY - pVertex[i].pY) / dy
+                                       * (pVertex[j].pX - pVertex[i].pX));
+            } else {
+                nodeX[nodes++] = pVertex[i].pX;
+            }
+        }
+    }
+    //Fl_Android_Application::log_e("%d nodes (must be even!)", nodes);
+
+    //  Sort the nodes, via a simple “Bubble” sort.
+    i = 0;
+    while (i < nodes - 1) {
+        if (nodeX[i] > nodeX[i + 1]) {
+            swap = nodeX[i];
+            nodeX[i] = nodeX[i + 1];
+            nodeX[i + 1] = swap;
+            if (i) i--;
+        } else {
+            i++;
+        }
+    }
+    return nodes;
+}
+
+
+/**
+ * Fill a complex polygon into a TILED bitmap, one row of tiles at a time.
+ *
+ * Only tiles that are crossed by the outline get pixel accurate spans.
+ * All other tiles are either entirely inside or entirely outside of the
+ * polygon, which is found by a single test per tile. Inside tiles are set
+ * to a uniform color without touching any pixels. The pixel work is in
+ * proportion to the length of the outline instead of the area.
+ *
+ * \param color 0 to clear pixels, anything else to set them
+ * \param xMin, xMax, yMin, yMax bounding box of the polygon in pixels
+ * \param nodeX scratch space for one crossing per vertex
+ */
+void IAFramebuffer::fillTiledPolygon(int color, int xMin, int xMax, int yMin, int yMax, int *nodeX)
+{
+    const int T = IATiledBitmap::kTileSize;
+    int tilesX = pTiledBitmap->tilesX(), tilesY = pTiledBitmap->tilesY();
+    if (yMin<0) yMin = 0;
+    if (yMax>pHeight) yMax = pHeight;
+    if (yMin>=yMax) return;
+    std::vector<char> isRim(tilesX);
+
+    for (int ty=yMin/T; ty<=(yMax-1)/T && ty<tilesY; ty++) {
+        int y0 = std::max(ty*T, yMin), y1 = std::min(ty*T+T, yMax);
+
+        // mark all tiles that an edge passes through, with a margin of a
+        // pixel for rounding
+        std::fill(isRim.begin(), isRim.end(), 0);
+        for (int i = 1; i < pnVertex; i++) {
+            const Vertex &a = pVertex[i-1], &b = pVertex[i];
+            if (a.pIsGap)
+                continue;
+            float ya = a.pY, yb = b.pY;
+            if (std::max(ya, yb) < y0-1 || std::min(ya, yb) > y1)
+                continue;
+            float xa = a.pX, xb = b.pX;
+            if (fabsf(yb-ya)>.0001) {
+                // clip the edge to the scanlines of this row of tiles
+                float ta = (y0-1-ya)/(yb-ya), tb = (y1-ya)/(yb-ya);
+                if (ta>tb) std::swap(ta, tb);
+                ta = std::max(ta, 0.0f);
+                tb = std::min(tb, 1.0f);
+                xa = a.pX + ta*(b.pX-a.pX);
+                xb = a.pX + tb*(b.pX-a.pX);
+            }
+            int x0 = (int)floorf(std::min(xa, xb))-1, x1 = (int)ceilf(std::max(xa, xb))+1;
+            int t0 = std::max(0, x0/T), t1 = std::min(tilesX-1, x1/T);
+            if (x0<0) t0 = 0;
+            for (int tx=t0; tx<=t1; tx++) isRim[tx] = 1;
+        }
+
+        // draw the rim tiles pixel by pixel
+        for (int pixelY = y0; pixelY < y1; pixelY++) {
+            int nodes = scanlineNodes(pixelY, nodeX);
+            for (int i = 0; i < nodes-1; i += 2) {
+                int a = std::max(nodeX[i], xMin), b = std::min(nodeX[i+1], xMax);
+                if (a>=b) continue;
+                for (int tx=a/T; tx<=(b-1)/T && tx<tilesX; tx++) {
+                    if (isRim[tx])
+                        pTiledBitmap->hline(std::max(a, tx*T), std::min(b, tx*T+T), pixelY, color);
+                }
+            }
+        }
+
+        // all other tiles are uniform; test their center on the first scanline
+        int nodes = scanlineNodes(y0, nodeX);
+        for (int i = 0; i < nodes-1; i += 2) {
+            int a = std::max(nodeX[i], xMin), b = std::min(nodeX[i+1], xMax);
+            if (a>=b) continue;
+            for (int tx=a/T; tx<=(b-1)/T && tx<tilesX; tx++) {
+                int cx = tx*T + T/2;
+                if (!isRim[tx] && cx>=a && cx<b)
+                    pTiledBitmap->fillTile(tx, ty, color);
+            }
+        }
+    }
+}
+
+
+/**
+ * Clear the gaps of a stripe pattern in a BITMAP or TILED buffer.
+ *
+ * Flat bitmaps are masked in place, one AND per word. Tiled bitmaps receive
+ * the mask row by row and skip all tiles that are empty.
+ *
+ * \param pattern stripes, measured in pixels
+ */
+void IAFramebuffer::overlayPattern(const IAStripePattern &pattern)
+{
+    int nWords = (pWidth+BM_WORDBITS-1)/BM_WORDBITS;
+    if (pBitmap) {
+        for (int y=0; y<pHeight; y++)
+            pattern.andRow(y, bm_scanline(pBitmap, y), nWords);
+    } else if (pTiledBitmap) {
+        potrace_word *mask = (potrace_word*)::malloc(nWords*sizeof(potrace_word));
+        for (int y=0; y<pHeight; y++) {
+            if (pattern.isHorizontal()) {
+                if (pattern.rowIsGap(y)) hline(0, pWidth, y, 0);
+            } else {
+                pattern.row(y, mask, nWords);
+                andRow(y, mask);
+            }
+        }
+        ::free((void*)mask);
+    }
+}
+
+
+/**
+ * Set or clear a horizontal run of pixels in a BITMAP or TILED buffer.
+ *
+ * \param x1, x2 first pixel and one past the last pixel; clipped to the buffer
+ * \param y scanline; lines outside of the buffer are ignored
+ * \param color 0 to clear pixels, anything else to set them
+ */
+void IAFramebuffer::hline(int x1, int x2, int y, int color)
+{
+    if (y<0 || y>=pHeight) return;
+    if (pTiledBitmap) {
+        pTiledBitmap->hline(x1, x2, y, color);
+    } else {
+        bm_hline(pBitmap, x1, x2, y, color);
+    }
+}
+
+
+/**
+ * Logic AND a scanline of a BITMAP or TILED buffer with a mask.
+ *
+ * \param y scanline; lines outside of the buffer are ignored
+ * \param mask one full scanline in potrace bitmap format
+ */
+void IAFramebuffer::andRow(int y, const potrace_word *mask)
+{
+    if (y<0 || y>=pHeight) return;
+    if (pTiledBitmap) {
+        pTiledBitmap->andRow(y, mask);
+    } else {
+        bm_word *dst = bm_scanline(pBitmap, y);
+        for (int x=0; x<pBitmap->dy; x++) {
+            *dst++ &= mask[x];
+        }
+    }
+}
+
+
 void IAFramebuffer::addPointRaw(float x, float y, bool gap)
 {
     if (pnVertex == pNVertex) {
@@ -10,6 +10,8 @@
 #include "Iota.h"
 #include "toolpath/IAToolpath.h"
 #include "potrace/potracelib.h"
+#include "opengl/IABitmapPool.h"
+#include "opengl/IAComponentLabeler.h"
 
 #include <FL/gl.h>
 #include <FL/glu.h>
@@ -29,6 +31,9 @@ extern const char *glIAErrorString(int err);
 
 class IAToolpath;
 class IAPrinter;
+class IATiledBitmap;
+class IASpanBitmap;
+class IAStripePattern;
 
 
 /**
@@ -64,6 +69,7 @@ extern bool initializeOpenGL();
  */
 class IAFramebuffer
 {
+    friend IAComponentLabeler;
 public:
     typedef unsigned long bm_word;
 
@@ -74,9 +80,18 @@ public:
         NONE = 0,
         RGBA,
         RGBAZ,
-        BITMAP
+        BITMAP,
+        TILED   ///< a BITMAP that is stored in sparse 64x64 pixel tiles
     } Buffers;
 
+    /**
+     * Outlines can be traced with curve fitting, or with straight segments only.
+     */
+    typedef enum {
+        POTRACE = 0,
+        MARCHING_SQUARES    ///< faster and fewer segments, see IAMarchingSquares
+    } Tracer;
+
     IAFramebuffer(IAPrinter*, Buffers type);
     IAFramebuffer(IAFramebuffer*);
     ~IAFramebuffer();
@@ -88,7 +103,7 @@ public:
     void draw(double z);
     uint8_t *getRawImageRGB();
     uint8_t *getRawImageRGBA();
-    int traceOutline(IAToolpathList *toolpathList, double z);
+    int traceOutline(IAToolpathList *toolpathList, double z, Tracer tracer=POTRACE);
     int saveAsJpeg(const char *filename, GLubyte *imgdata=nullptr);
     int saveAsPng(const char *filename, int components, GLubyte *imgdata=nullptr, bool rle=false);
 
@@ -103,17 +118,37 @@ public:
     /** Buffer type */
     Buffers buffers() { return pBuffers; }
 
+    void setSize(int w, int h);
+    void updateSize();
+
+    /** Return true if this is a one bit per pixel buffer, flat or tiled. */
+    bool isBitmap() { return pBuffers==BITMAP || pBuffers==TILED; }
+
     void logicAndNot(IAFramebuffer*);
     void logicAnd(IAFramebuffer*);
 
+    void compress();
+    void expand();
+
+    /** Return true if the bitmap is stored as spans and can only be read. */
+    bool isCompressed() { return pSpanBitmap!=nullptr; }
+
+    void readRow(int y, potrace_word *dst);
+    bool contentBounds(int &x0, int &y0, int &x1, int &y1);
+    void copyToBitmap(potrace_bitmap_t *dst, int x0, int y0);
+
+    int removeSpeckles(long minArea, IAComponentLabeler *labeler=nullptr);
+
     void subtract(IAToolpathListSP, double r);
     void add(IAToolpathListSP, double r);
-    IAToolpathListSP toolpathFromLassoAndContract(double z, double r);
-    IAToolpathListSP toolpathFromLassoAndExpand(double z, double r);
-    IAToolpathListSP toolpathFromLasso(double z);
+    IAToolpathListSP toolpathFromLassoAndContract(double z, double r, Tracer tracer=POTRACE);
+    IAToolpathListSP toolpathFromLassoAndExpand(double z, double r, Tracer tracer=POTRACE);
+    IAToolpathListSP toolpathFromLasso(double z, Tracer tracer=POTRACE);
 
     void overlayLidPattern(int i, double w);
     void overlayInfillPattern(int i, double w);
+    IAToolpathListSP toolpathFromZigzag(double z, int i, double w);
+    void overlayPattern(const IAStripePattern &pattern);
 
     void drawLid(IAEdgeList &rim);
 
@@ -134,6 +169,16 @@ protected:
     void deleteFBO();
 
     void addPointRaw(float x, float y, bool gap=false);
+    int scanlineNodes(int y, int *nodeX);
+    void fillTiledPolygon(int color, int xMin, int xMax, int yMin, int yMax, int *nodeX);
+    void hline(int x1, int x2, int y, int color);
+    void andRow(int y, const potrace_word *mask);
+    void logicAndSpans(IASpanBitmap *src, bool invert);
+
+    void newBitmap();
+    void releaseBitmap();
+    bool isBitmapShared();
+    void makeBitmapUnique();
 
     class Vertex {
     public:
@@ -146,11 +191,11 @@ protected:
     Vertex *pVertex = nullptr;
 
 
-    /** Width of the framebuffer in pixles */
-    int pWidth = kFramebufferSize;
+    /** Width of the framebuffer in pixles, see IAPrinter::rasterPitch */
+    int pWidth = 0;
 
     /** Height of the framebuffer in pixles */
-    int pHeight = kFramebufferSize; // see Iota.cpp
+    int pHeight = 0;
 
     /** Set this flag if the OpenGL framebuffer object is created */
     bool pFramebufferCreated = false;
@@ -170,8 +215,16 @@ protected:
     /** Use this to retrieve the build volume when rendering. */
     IAPrinter *pPrinter = nullptr;
 
+    /** Owner of pBitmap; copies of this buffer share it until one is modified. */
+    IABitmapSP pBitmapRef;
+
+    /** Owner of pTiledBitmap; copies of this buffer share it until one is modified. */
+    std::shared_ptr<IATiledBitmap> pTiledBitmapRef;
+
 public:
     potrace_bitmap_t *pBitmap = nullptr;
+    IATiledBitmap *pTiledBitmap = nullptr;
+    IASpanBitmap *pSpanBitmap = nullptr;
 };
 
 
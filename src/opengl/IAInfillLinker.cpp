@@ -0,0 +1,207 @@
+//
+//  IAInfillLinker.cpp
+//
+//  Copyright (c) 2013-2018 Matthias Melcher. All rights reserved.
+//
+
+
+#include "IAInfillLinker.h"
+
+#include "opengl/IAFramebuffer.h"
+#include "toolpath/IAToolpath.h"
+#include "potrace/bitmap.h"
+
+#include <math.h>
+#include <algorithm>
+
+
+/** Links can be this many times longer than the distance between diagonals */
+static const double kMaxLink = 3.0;
+
+
+/**
+ * Create an infill linker.
+ *
+ * \param spacing distance between neighboring lines, in pixels
+ * \param ascending lines run along x-y=c if set, and along x+y=c if clear
+ */
+IAInfillLinker::IAInfillLinker(double spacing, bool ascending)
+:   pSpacing( spacing ),
+    pAscending( ascending )
+{
+    if (pSpacing<1.0) pSpacing = 1.0;
+}
+
+
+/**
+ * Return true if a pixel of the traced area is set.
+ */
+bool IAInfillLinker::sample(int x, int y) const
+{
+    if (x<0 || x>=pWidth || y<0 || y>=pHeight) return false;
+    return (pMap[(size_t)y*pWords + x/BM_WORDBITS] & bm_mask(x)) != 0;
+}
+
+
+/**
+ * Return the row of the pixel at column x on a diagonal.
+ */
+int IAInfillLinker::lineY(int line, int x) const
+{
+    int c = pLineC[line];
+    return pAscending ? x-c : c-x;
+}
+
+
+/**
+ * Check if a straight link between two pixels stays inside the set pixels.
+ *
+ * Links along the outline cut the corners of the pixel steps, so a point on
+ * the link is inside if any of the four pixels around it is set.
+ */
+bool IAInfillLinker::isInside(int lineA, int xa, int lineB, int xb) const
+{
+    double ax = xa, ay = lineY(lineA, xa);
+    double bx = xb, by = lineY(lineB, xb);
+    double len = hypot(bx-ax, by-ay);
+    int n = (int)ceil(len*2.0);
+    for (int i=1; i<n; i++) {
+        double t = (double)i/n;
+        int x = (int)floor(ax+t*(bx-ax)), y = (int)floor(ay+t*(by-ay));
+        if (!sample(x, y) && !sample(x+1, y) && !sample(x, y+1) && !sample(x+1, y+1))
+            return false;
+    }
+    return true;
+}
+
+
+/**
+ * Find all runs of set pixels along a diagonal.
+ */
+void IAInfillLinker::addSegments(int line)
+{
+    int c = pLineC[line];
+    int xMin, xMax;
+    if (pAscending) {
+        xMin = std::max(0, c);
+        xMax = std::min(pWidth, pHeight+c);
+    } else {
+        xMin = std::max(0, c-pHeight+1);
+        xMax = std::min(pWidth, c+1);
+    }
+    int x = xMin;
+    while (x<xMax) {
+        if (!sample(x, lineY(line, x))) {
+            x++;
+            continue;
+        }
+        int x0 = x;
+        while (x<xMax && sample(x, lineY(line, x))) x++;
+        // a single pixel would be printed as a blob
+        if (x-1>x0)
+            pSegment.push_back( { line, x0, x-1 } );
+    }
+}
+
+
+/**
+ * Find the segment on the next diagonal that a path can continue with.
+ *
+ * \param line, x the path ends at this pixel
+ * \param atEnd continue at the last pixel of the next segment if set, or at
+ *      its first pixel if clear
+ * \return index of the segment, or -1 if there is none
+ */
+int IAInfillLinker::findLink(int line, int x, bool atEnd) const
+{
+    if (line+1>=(int)pLineC.size()) return -1;
+    double px = x, py = lineY(line, x);
+    double maxDist = kMaxLink*pSpacing;
+    int best = -1;
+    double bestDist = maxDist*maxDist;
+    for (int s=pLineStart[line+1]; s<pLineStart[line+2]; s++) {
+        if (pUsed[s]) continue;
+        int sx = atEnd ? pSegment[s].x1 : pSegment[s].x0;
+        double dx = sx-px, dy = lineY(line+1, sx)-py;
+        double d = dx*dx + dy*dy;
+        if (d<=bestDist && isInside(line, x, line+1, sx)) {
+            bestDist = d;
+            best = s;
+        }
+    }
+    return best;
+}
+
+
+/**
+ * Fill the set pixels of a framebuffer with zigzag lines.
+ *
+ * Lines are placed at multiples of the spacing in framebuffer coordinates,
+ * so they are at the same position in every layer with the same direction.
+ *
+ * \param fb a BITMAP, TILED, or RGBA framebuffer
+ * \param toolpath add all zigzag paths to this list
+ * \param z give all segments in the toolpath a z position
+ * \param xScl, yScl size of a pixel in world space
+ *
+ * \return 0 on success
+ */
+int IAInfillLinker::link(IAFramebuffer *fb, IAToolpathList *toolpath, double z,
+                         double xScl, double yScl)
+{
+    int x1, y1;
+    if (!fb->contentBounds(pX0, pY0, x1, y1))
+        return 0;
+    pWidth = x1-pX0;
+    pHeight = y1-pY0;
+    pWords = (pWidth+BM_WORDBITS-1)/BM_WORDBITS;
+    pMap.resize((size_t)pWords*pHeight);
+    potrace_bitmap_t bm = { pWidth, pHeight, pWords, pMap.data() };
+    fb->copyToBitmap(&bm, pX0, pY0);
+
+    // diagonals at a distance of pSpacing are this far apart along x
+    double step = pSpacing*M_SQRT2;
+    int cOffset = pAscending ? pX0-pY0 : pX0+pY0;
+    int cMin = pAscending ? -(pHeight-1) : 0;
+    int cMax = pAscending ? pWidth-1 : pWidth+pHeight-2;
+    pLineC.clear();
+    for (long k=(long)ceil((cMin+cOffset)/step); k*step<=cMax+cOffset; k++)
+        pLineC.push_back((int)lround(k*step)-cOffset);
+
+    pSegment.clear();
+    pLineStart.assign(1, 0);
+    for (int line=0; line<(int)pLineC.size(); line++) {
+        addSegments(line);
+        pLineStart.push_back((int)pSegment.size());
+    }
+    pUsed.assign(pSegment.size(), 0);
+
+    for (size_t first=0; first<pSegment.size(); first++) {
+        if (pUsed[first]) continue;
+        IAToolpathLine *path = new IAToolpathLine(z);
+        int s = (int)first;
+        bool forward = true;
+        bool start = true;
+        while (s>=0) {
+            pUsed[s] = 1;
+            const Segment &seg = pSegment[s];
+            int xa = forward ? seg.x0 : seg.x1;
+            int xb = forward ? seg.x1 : seg.x0;
+            double ax = (xa+pX0+0.5)*xScl, ay = (lineY(seg.line, xa)+pY0+0.5)*yScl;
+            double bx = (xb+pX0+0.5)*xScl, by = (lineY(seg.line, xb)+pY0+0.5)*yScl;
+            if (start) {
+                path->startPath(ax, ay);
+                start = false;
+            } else {
+                path->continuePath(ax, ay);
+            }
+            path->continuePath(bx, by);
+            // the next segment starts at the same end and runs the other way
+            s = findLink(seg.line, xb, forward);
+            forward = !forward;
+        }
+        toolpath->add(path, 0, 0, 0);
+    }
+    return 0;
+}
+
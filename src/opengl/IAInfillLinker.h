@@ -0,0 +1,79 @@
+//
+//  IAInfillLinker.h
+//
+//  Copyright (c) 2013-2018 Matthias Melcher. All rights reserved.
+//
+
+#ifndef IA_INFILL_LINKER_H
+#define IA_INFILL_LINKER_H
+
+
+#include "potrace/potracelib.h"
+
+#include <vector>
+
+
+class IAFramebuffer;
+class IAToolpathList;
+
+
+/**
+ * Fill an area with diagonal lines that are linked into zigzag paths.
+ *
+ * The area is cut into segments along evenly spaced diagonals. The end of
+ * a segment is linked to the nearest end of a segment on the next diagonal
+ * if the link stays inside the area, which makes it run along the outline.
+ * Linked segments alternate their direction and form a single open
+ * toolpath. Where no link is possible, the path ends, and the travel
+ * optimizer moves the head to the next one.
+ *
+ * Tracing the outlines of a striped area creates a loop for every stripe,
+ * and every loop needs a travel move with a retraction. Linked zigzags
+ * need only a few.
+ */
+class IAInfillLinker
+{
+public:
+    IAInfillLinker(double spacing, bool ascending);
+
+    int link(IAFramebuffer *fb, IAToolpathList *toolpath, double z,
+             double xScl, double yScl);
+
+protected:
+    /** A run of set pixels along a diagonal; x0 and x1 are the first and last pixel. */
+    struct Segment {
+        int line;
+        int x0, x1;
+    };
+
+    bool sample(int x, int y) const;
+    int lineY(int line, int x) const;
+    bool isInside(int lineA, int xa, int lineB, int xb) const;
+    void addSegments(int line);
+    int findLink(int line, int x, bool atEnd) const;
+
+    /** Distance between neighboring diagonals, in pixels */
+    double pSpacing = 1.0;
+
+    /** Set if the diagonals run along x-y=c, clear if they run along x+y=c */
+    bool pAscending = true;
+
+    /** The traced rectangle of the framebuffer */
+    std::vector<potrace_word> pMap;
+    int pX0 = 0, pY0 = 0, pWidth = 0, pHeight = 0, pWords = 0;
+
+    /** Value of c in local pixel coordinates for every diagonal */
+    std::vector<int> pLineC;
+
+    /** Segments sorted by diagonal and then by x */
+    std::vector<Segment> pSegment;
+
+    /** First segment of every diagonal, plus one entry at the end */
+    std::vector<int> pLineStart;
+
+    /** Set for every segment that is already part of a path */
+    std::vector<char> pUsed;
+};
+
+
+#endif /* IA_INFILL_LINKER_H */
@@ -0,0 +1,263 @@
+//
+//  IAMarchingSquares.cpp
+//
+//  Copyright (c) 2013-2018 Matthias Melcher. All rights reserved.
+//
+
+
+#include "IAMarchingSquares.h"
+
+#include "opengl/IAFramebuffer.h"
+#include "toolpath/IAToolpath.h"
+#include "potrace/bitmap.h"
+
+#include <math.h>
+#include <unordered_map>
+
+
+/** Loops that enclose this many pixels or fewer are dropped, see param->turdsize in IAPotrace.cpp */
+static const double kTurdSize = 20.0;
+
+
+/**
+ * The segments of every cell, as pairs of start and end edge.
+ *
+ * Corners are numbered 1=(x, y), 2=(x+1, y), 4=(x+1, y+1), 8=(x, y+1).
+ * Edges are 0=bottom, 1=right, 2=top, 3=left. The set corners are always on
+ * the left side of a segment. The saddles 5 and 10 connect their set
+ * corners.
+ */
+static const signed char kCellSegments[16][4] = {
+    { -1, -1, -1, -1 },
+    {  0,  3, -1, -1 },
+    {  1,  0, -1, -1 },
+    {  1,  3, -1, -1 },
+    {  2,  1, -1, -1 },
+    {  0,  1,  2,  3 },
+    {  2,  0, -1, -1 },
+    {  2,  3, -1, -1 },
+    {  3,  2, -1, -1 },
+    {  0,  2, -1, -1 },
+    {  3,  0,  1,  2 },
+    {  1,  2, -1, -1 },
+    {  3,  1, -1, -1 },
+    {  0,  1, -1, -1 },
+    {  3,  0, -1, -1 },
+    { -1, -1, -1, -1 }
+};
+
+
+/**
+ * Create a tracer.
+ *
+ * \param tolerance maximum distance of the simplified loops from the
+ *      outline, in pixels
+ */
+IAMarchingSquares::IAMarchingSquares(double tolerance)
+:   pTolerance( tolerance )
+{
+}
+
+
+/**
+ * Return true if a pixel in a scanline of the traced area is set.
+ */
+bool IAMarchingSquares::sample(const potrace_word *row, int x) const
+{
+    if (x<0 || x>=pWidth) return false;
+    return (row[x/BM_WORDBITS] & bm_mask(x)) != 0;
+}
+
+
+/**
+ * Return a unique number for an edge between two pixel centers.
+ *
+ * \param x, y the pixel at the start of the edge, -1 for the border
+ * \param side 0 for the edge to the right, 1 for the edge upwards
+ */
+long IAMarchingSquares::edgeId(int x, int y, int side) const
+{
+    return ((long)(y+1)*(pWidth+2) + (x+1))*2 + side;
+}
+
+
+/**
+ * Return the midpoint of an edge in pixels.
+ */
+IAMarchingSquares::Point IAMarchingSquares::edgePoint(long id) const
+{
+    long k = id/2;
+    int x = (int)(k%(pWidth+2)) - 1;
+    int y = (int)(k/(pWidth+2)) - 1;
+    // pixel centers are at x+0.5, y+0.5
+    if (id&1)
+        return { x+0.5, y+1.0 };
+    else
+        return { x+1.0, y+0.5 };
+}
+
+
+/**
+ * Add the segments of the cell between pixel centers (x, y) and (x+1, y+1).
+ */
+void IAMarchingSquares::addCell(int x, int y, int c)
+{
+    long edge[4] = {
+        edgeId(x, y, 0), edgeId(x+1, y, 1), edgeId(x, y+1, 0), edgeId(x, y, 1)
+    };
+    const signed char *s = kCellSegments[c];
+    for (int i=0; i<4 && s[i]>=0; i+=2) {
+        pSegStart.push_back(edge[(int)s[i]]);
+        pSegEnd.push_back(edge[(int)s[i+1]]);
+    }
+}
+
+
+/**
+ * Return the distance of a point from a line segment.
+ */
+static double distance(double px, double py, double ax, double ay, double bx, double by)
+{
+    double dx = bx-ax, dy = by-ay;
+    double len2 = dx*dx + dy*dy;
+    double t = len2>0.0 ? ((px-ax)*dx + (py-ay)*dy)/len2 : 0.0;
+    if (t<0.0) t = 0.0; else if (t>1.0) t = 1.0;
+    double ex = ax+t*dx-px, ey = ay+t*dy-py;
+    return sqrt(ex*ex + ey*ey);
+}
+
+
+/**
+ * Simplify a closed loop with the Douglas-Peucker algorithm.
+ *
+ * The loop is split at its first point and the point that is farthest
+ * away from it. Both halves are simplified without recursion.
+ *
+ * \param loop the points of the loop; the first point is not repeated at the end
+ * \param dst receives the points that are kept, in the same order
+ */
+void IAMarchingSquares::simplify(const std::vector<Point> &loop, std::vector<Point> &dst) const
+{
+    int n = (int)loop.size();
+    dst.clear();
+    if (n<3) return;
+
+    int far = 0;
+    double farDist = -1.0;
+    for (int i=1; i<n; i++) {
+        double dx = loop[i].x-loop[0].x, dy = loop[i].y-loop[0].y;
+        double d = dx*dx + dy*dy;
+        if (d>farDist) { farDist = d; far = i; }
+    }
+
+    // index n stands for the first point again
+    std::vector<char> keep(n+1, 0);
+    keep[0] = keep[far] = keep[n] = 1;
+    std::vector<std::pair<int, int>> stack = { { 0, far }, { far, n } };
+    while (!stack.empty()) {
+        int a = stack.back().first, b = stack.back().second;
+        stack.pop_back();
+        const Point &pa = loop[a], &pb = loop[b%n];
+        int best = -1;
+        double bestDist = pTolerance;
+        for (int i=a+1; i<b; i++) {
+            double d = distance(loop[i].x, loop[i].y, pa.x, pa.y, pb.x, pb.y);
+            if (d>bestDist) { bestDist = d; best = i; }
+        }
+        if (best>=0) {
+            keep[best] = 1;
+            stack.push_back( { a, best } );
+            stack.push_back( { best, b } );
+        }
+    }
+    for (int i=0; i<n; i++)
+        if (keep[i]) dst.push_back(loop[i]);
+}
+
+
+/**
+ * Trace all outlines of a framebuffer and add a loop for each to a toolpath.
+ *
+ * \param fb a BITMAP, TILED, or RGBA framebuffer
+ * \param toolpath add all loops to this list
+ * \param z give all segments in the toolpath a z position
+ * \param xScl, yScl size of a pixel in world space
+ *
+ * \return 0 on success
+ */
+int IAMarchingSquares::trace(IAFramebuffer *fb, IAToolpathList *toolpath, double z,
+                             double xScl, double yScl)
+{
+    int x0, y0, x1, y1;
+    if (!fb->contentBounds(x0, y0, x1, y1))
+        return 0;
+    pWidth = x1-x0;
+    pHeight = y1-y0;
+    pWords = (pWidth+BM_WORDBITS-1)/BM_WORDBITS;
+    pMap.resize((size_t)pWords*pHeight);
+    potrace_bitmap_t bm = { pWidth, pHeight, pWords, pMap.data() };
+    fb->copyToBitmap(&bm, x0, y0);
+
+    // find all cells that are crossed by an outline
+    pSegStart.clear();
+    pSegEnd.clear();
+    std::vector<potrace_word> zero(pWords, 0);
+    for (int y=-1; y<pHeight; y++) {
+        const potrace_word *r0 = y>=0 ? bm_scanline(&bm, y) : zero.data();
+        const potrace_word *r1 = y+1<pHeight ? bm_scanline(&bm, y+1) : zero.data();
+        if (sample(r0, 0) || sample(r1, 0))
+            addCell(-1, y, (sample(r0, 0) ? 2 : 0) | (sample(r1, 0) ? 4 : 0));
+        for (int i=0; i<pWords; i++) {
+            // skip words where all four corners of every cell are the same
+            potrace_word a = r0[i], b = r1[i];
+            bool na = i+1<pWords && (r0[i+1] & BM_HIBIT);
+            bool nb = i+1<pWords && (r1[i+1] & BM_HIBIT);
+            if (a==b && na==nb && ((a==0 && !na) || (a==BM_ALLBITS && na)))
+                continue;
+            int xEnd = (i+1)*BM_WORDBITS;
+            if (xEnd>pWidth) xEnd = pWidth;
+            for (int x=i*BM_WORDBITS; x<xEnd; x++) {
+                int c = (sample(r0, x) ? 1 : 0) | (sample(r0, x+1) ? 2 : 0)
+                      | (sample(r1, x+1) ? 4 : 0) | (sample(r1, x) ? 8 : 0);
+                if (c!=0 && c!=15)
+                    addCell(x, y, c);
+            }
+        }
+    }
+
+    // every edge starts exactly one segment, so the segments link into loops
+    std::unordered_map<long, int> next;
+    next.reserve(pSegStart.size());
+    for (size_t i=0; i<pSegStart.size(); i++)
+        next[pSegStart[i]] = (int)i;
+
+    std::vector<char> used(pSegStart.size(), 0);
+    std::vector<Point> loop, simple;
+    for (size_t s=0; s<pSegStart.size(); s++) {
+        if (used[s]) continue;
+        loop.clear();
+        double area = 0.0;
+        int i = (int)s;
+        while (!used[i]) {
+            used[i] = 1;
+            Point p = edgePoint(pSegStart[i]), q = edgePoint(pSegEnd[i]);
+            loop.push_back(p);
+            area += p.x*q.y - q.x*p.y;
+            auto it = next.find(pSegEnd[i]);
+            if (it==next.end()) break;
+            i = it->second;
+        }
+        if (fabs(area)/2.0 <= kTurdSize)
+            continue;
+        simplify(loop, simple);
+        if (simple.size()<3)
+            continue;
+        IAToolpathLoop *toolpathLoop = new IAToolpathLoop(z);
+        toolpathLoop->startPath((simple[0].x+x0)*xScl, (simple[0].y+y0)*yScl);
+        for (size_t k=1; k<simple.size(); k++)
+            toolpathLoop->continuePath((simple[k].x+x0)*xScl, (simple[k].y+y0)*yScl);
+        toolpathLoop->closePath();
+        toolpath->add(toolpathLoop, 0, 0, 0);
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+//
+//  IAMarchingSquares.h
+//
+//  Copyright (c) 2013-2018 Matthias Melcher. All rights reserved.
+//
+
+#ifndef IA_MARCHING_SQUARES_H
+#define IA_MARCHING_SQUARES_H
+
+
+#include "potrace/potracelib.h"
+
+#include <vector>
+
+
+class IAFramebuffer;
+class IAToolpathList;
+
+
+/**
+ * Trace the outlines of a bitmap with straight segments only.
+ *
+ * The grid of pixel centers is walked cell by cell. Every cell with set and
+ * unset corners adds a segment between the midpoints of the edges that
+ * cross the outline. Diagonal pixels are connected, just like in
+ * IAComponentLabeler. The segments are linked into closed loops, and
+ * every loop is simplified with the Douglas-Peucker algorithm.
+ *
+ * This is a lot faster than potrace and creates fewer segments, but it does
+ * not fit curves. It is good enough for infill, lids, and support, where
+ * the outline is covered by other toolpaths anyway.
+ *
+ * Outer loops run counterclockwise and holes run clockwise, just like the
+ * loops that potrace creates.
+ */
+class IAMarchingSquares
+{
+public:
+    IAMarchingSquares(double tolerance);
+
+    int trace(IAFramebuffer *fb, IAToolpathList *toolpath, double z,
+              double xScl, double yScl);
+
+protected:
+    /** A point on the outline, in pixels. */
+    struct Point {
+        double x, y;
+    };
+
+    bool sample(const potrace_word *row, int x) const;
+    long edgeId(int x, int y, int side) const;
+    Point edgePoint(long id) const;
+    void addCell(int x, int y, int c);
+    void simplify(const std::vector<Point> &loop, std::vector<Point> &dst) const;
+
+    /** Maximum distance of the simplified loop from the outline, in pixels */
+    double pTolerance = 0.5;
+
+    /** The traced rectangle of the framebuffer */
+    std::vector<potrace_word> pMap;
+    int pWidth = 0, pHeight = 0, pWords = 0;
+
+    /** Start and end edge of every segment */
+    std::vector<long> pSegStart, pSegEnd;
+};
+
+
+#endif /* IA_MARCHING_SQUARES_H */
@@ -0,0 +1,205 @@
+//
+//  IASpanBitmap.cpp
+//
+//  Copyright (c) 2013-2018 Matthias Melcher. All rights reserved.
+//
+
+
+#include "IASpanBitmap.h"
+
+#include "potrace/bitmap.h"
+
+#include <string.h>
+
+
+/**
+ * Create an empty span bitmap.
+ *
+ * \param w, h size of the bitmap in pixels
+ */
+IASpanBitmap::IASpanBitmap(int w, int h)
+:   pWidth( w ),
+    pHeight( h ),
+    pWords( w==0 ? 0 : (w-1)/BM_WORDBITS+1 )
+{
+}
+
+
+IASpanBitmap::~IASpanBitmap()
+{
+}
+
+
+/**
+ * Start encoding a new image; rows must then be added from bottom to top.
+ */
+void IASpanBitmap::beginEncoding()
+{
+    pY0 = pY1 = 0;
+    pRowStart.clear();
+    pSpans.clear();
+}
+
+
+/**
+ * Append the next row of the image.
+ *
+ * Empty rows before the first row with pixels are not stored. Words that are
+ * completely clear or completely set are skipped without looking at the bits.
+ *
+ * \param y row number, must be one higher than the previous row
+ * \param row one potrace scanline
+ */
+void IASpanBitmap::encodeRow(int y, const potrace_word *row)
+{
+    size_t n = pSpans.size();
+    bool inSpan = false;
+    for (int i=0; i<pWords; i++) {
+        potrace_word w = row[i];
+        if ( (!inSpan && w==0) || (inSpan && w==BM_ALLBITS) )
+            continue;
+        int x = i*BM_WORDBITS;
+        for (potrace_word m=BM_HIBIT; m; m>>=1, x++) {
+            if (x>=pWidth) break;
+            bool set = (w & m)!=0;
+            if (set!=inSpan) {
+                pSpans.push_back((Coord)x);
+                inSpan = set;
+            }
+        }
+    }
+    if (inSpan)
+        pSpans.push_back((Coord)pWidth);
+
+    if (pRowStart.empty()) {
+        if (pSpans.size()==n) return; // still below the content
+        pY0 = y;
+        pRowStart.push_back(0);
+    }
+    pRowStart.push_back((uint32_t)pSpans.size());
+    pY1 = y+1;
+}
+
+
+/**
+ * Finish encoding, remove empty rows at the top and release unused memory.
+ */
+void IASpanBitmap::endEncoding()
+{
+    while (pRowStart.size()>1 && pRowStart[pRowStart.size()-1]==pRowStart[pRowStart.size()-2]) {
+        pRowStart.pop_back();
+        pY1--;
+    }
+    if (pRowStart.size()<=1) {
+        pRowStart.clear();
+        pY0 = pY1 = 0;
+    }
+    pRowStart.shrink_to_fit();
+    pSpans.shrink_to_fit();
+}
+
+
+bool IASpanBitmap::spansInRow(int y, const Coord *&s, const Coord *&e) const
+{
+    if (y<pY0 || y>=pY1) return false;
+    const Coord *base = pSpans.data();
+    s = base + pRowStart[y-pY0];
+    e = base + pRowStart[y-pY0+1];
+    return s!=e;
+}
+
+
+/**
+ * Set all pixels x1 to x2-1 in a potrace scanline.
+ */
+void IASpanBitmap::setRange(potrace_word *row, int x1, int x2)
+{
+    if (x1>=x2) return;
+    int i1 = x1/BM_WORDBITS, i2 = (x2-1)/BM_WORDBITS;
+    potrace_word m1 = BM_ALLBITS >> (x1 % BM_WORDBITS);
+    potrace_word m2 = BM_ALLBITS << (BM_WORDBITS-1 - (x2-1) % BM_WORDBITS);
+    if (i1==i2) {
+        row[i1] |= m1 & m2;
+    } else {
+        row[i1] |= m1;
+        for (int i=i1+1; i<i2; i++) row[i] = BM_ALLBITS;
+        row[i2] |= m2;
+    }
+}
+
+
+/**
+ * Clear all pixels x1 to x2-1 in a potrace scanline.
+ */
+void IASpanBitmap::clearRange(potrace_word *row, int x1, int x2)
+{
+    if (x1>=x2) return;
+    int i1 = x1/BM_WORDBITS, i2 = (x2-1)/BM_WORDBITS;
+    potrace_word m1 = BM_ALLBITS >> (x1 % BM_WORDBITS);
+    potrace_word m2 = BM_ALLBITS << (BM_WORDBITS-1 - (x2-1) % BM_WORDBITS);
+    if (i1==i2) {
+        row[i1] &= ~(m1 & m2);
+    } else {
+        row[i1] &= ~m1;
+        for (int i=i1+1; i<i2; i++) row[i] = 0;
+        row[i2] &= ~m2;
+    }
+}
+
+
+/**
+ * Write one row of the image into a potrace scanline.
+ */
+void IASpanBitmap::decodeRow(int y, potrace_word *row) const
+{
+    memset(row, 0, pWords*sizeof(potrace_word));
+    const Coord *s, *e;
+    if (!spansInRow(y, s, e)) return;
+    for ( ; s<e; s+=2)
+        setRange(row, s[0], s[1]);
+}
+
+
+/**
+ * Logic AND one row of the image onto a potrace scanline.
+ *
+ * Only the gaps between spans are touched.
+ */
+void IASpanBitmap::andRow(int y, potrace_word *row) const
+{
+    const Coord *s, *e;
+    if (!spansInRow(y, s, e)) {
+        memset(row, 0, pWords*sizeof(potrace_word));
+        return;
+    }
+    int x = 0;
+    for ( ; s<e; s+=2) {
+        clearRange(row, x, s[0]);
+        x = s[1];
+    }
+    clearRange(row, x, pWords*BM_WORDBITS);
+}
+
+
+/**
+ * Logic AND NOT one row of the image onto a potrace scanline.
+ */
+void IASpanBitmap::andNotRow(int y, potrace_word *row) const
+{
+    const Coord *s, *e;
+    if (!spansInRow(y, s, e)) return;
+    for ( ; s<e; s+=2)
+        clearRange(row, s[0], s[1]);
+}
+
+
+/**
+ * Return the number of bytes used for the encoded image.
+ */
+size_t IASpanBitmap::memoryUsage() const
+{
+    return sizeof(*this)
+        + pRowStart.capacity()*sizeof(uint32_t)
+        + pSpans.capacity()*sizeof(Coord);
+}
+
@@ -0,0 +1,81 @@
+//
+//  IASpanBitmap.h
+//
+//  Copyright (c) 2013-2018 Matthias Melcher. All rights reserved.
+//
+
+#ifndef IA_SPAN_BITMAP_H
+#define IA_SPAN_BITMAP_H
+
+
+#include "potrace/potracelib.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+
+/**
+ * A read-only one bit per pixel image, stored as runs of set pixels per row.
+ *
+ * Core patterns of a layer are kept for the entire slicing job, because lids
+ * and infill need the layers above and below. A layer is mostly made of a
+ * few large areas, so every row compresses into a handful of spans. Rows
+ * above and below the content are not stored at all.
+ *
+ * The decoder writes directly into potrace scanlines, so the image never
+ * needs to be expanded into a full bitmap just to be combined with another.
+ */
+class IASpanBitmap
+{
+public:
+    /** One coordinate of a span; bitmaps can be up to 65535 pixels wide. */
+    typedef uint16_t Coord;
+
+    IASpanBitmap(int w, int h);
+    ~IASpanBitmap();
+
+    /** Width in pixels. */
+    int width() const { return pWidth; }
+
+    /** Height in pixels. */
+    int height() const { return pHeight; }
+
+    void beginEncoding();
+    void encodeRow(int y, const potrace_word *row);
+    void endEncoding();
+
+    void decodeRow(int y, potrace_word *row) const;
+    void andRow(int y, potrace_word *row) const;
+    void andNotRow(int y, potrace_word *row) const;
+
+    size_t memoryUsage() const;
+
+    static void setRange(potrace_word *row, int x1, int x2);
+    static void clearRange(potrace_word *row, int x1, int x2);
+
+protected:
+    /** Find the spans of row y; returns false if the row is empty. */
+    bool spansInRow(int y, const Coord *&s, const Coord *&e) const;
+
+    int pWidth = 0;
+    int pHeight = 0;
+
+    /** First row that is stored. */
+    int pY0 = 0;
+
+    /** One past the last row that is stored. */
+    int pY1 = 0;
+
+    /** Number of words in a potrace scanline of this width. */
+    int pWords = 0;
+
+    /** For every stored row, the index of its first span in pSpans, plus one end marker. */
+    std::vector<uint32_t> pRowStart;
+
+    /** Pairs of pixel coordinates, start of span and one past the end of span. */
+    std::vector<Coord> pSpans;
+};
+
+
+#endif /* IA_SPAN_BITMAP_H */
@@ -0,0 +1,162 @@
+//
+//  IAStripePattern.cpp
+//
+//  Copyright (c) 2013-2018 Matthias Melcher. All rights reserved.
+//
+
+
+#include "IAStripePattern.h"
+
+#include "potrace/bitmap.h"
+
+#include <map>
+#include <mutex>
+#include <math.h>
+
+
+static std::mutex gTableMutex;
+static std::map<std::pair<int, int>, std::vector<potrace_word> > gTableCache;
+
+
+/**
+ * Positive remainder of a division.
+ */
+static inline int positiveMod(long a, int b)
+{
+    long r = a % b;
+    return (int)(r<0 ? r+b : r);
+}
+
+
+/**
+ * Create a stripe pattern.
+ *
+ * All distances are given in pixels, measured at a right angle to the stripes.
+ *
+ * \param period distance from the start of one gap to the start of the next
+ * \param gap width of the gap between two stripes, these pixels are cleared
+ * \param angle direction of the stripes in degrees; 0 runs along the
+ *      scanlines, 90 runs across, 45 and -45 are the two diagonals
+ * \param phase move the pattern by this distance
+ */
+IAStripePattern::IAStripePattern(double period, double gap, double angle, double phase)
+{
+    double s = sin(angle/180.0*M_PI);
+    double c = cos(angle/180.0*M_PI);
+    if (fabs(s)<1e-6) {
+        pRowPeriod = (int)lround(period);
+        if (pRowPeriod<1) pRowPeriod = 1;
+        pRowGap = (int)lround(gap);
+        if (gap>0.0 && pRowGap<1) pRowGap = 1;
+        pRowPhase = (int)lround(phase);
+        return;
+    }
+    // stretch the pattern to where the stripes cross a scanline
+    double as = fabs(s);
+    pPeriod = (int)lround(period/as);
+    if (pPeriod<1) pPeriod = 1;
+    pGap = (int)lround(gap/as);
+    if (gap>0.0 && pGap<1) pGap = 1;
+    if (pGap>pPeriod) pGap = pPeriod;
+    pShear = c/s;
+    pShift = phase/s;
+    pTable = table(pPeriod, pGap);
+}
+
+
+/**
+ * Find or create the table of words for a given period and gap.
+ *
+ * Bit k of word i in the table tells if pixel i+k of a period is kept.
+ */
+const std::vector<potrace_word> *IAStripePattern::table(int period, int gap)
+{
+    std::lock_guard<std::mutex> lock(gTableMutex);
+    auto key = std::make_pair(period, gap);
+    auto it = gTableCache.find(key);
+    if (it!=gTableCache.end())
+        return &it->second;
+    std::vector<potrace_word> &t = gTableCache[key];
+    t.resize(period);
+    for (int i=0; i<period; i++) {
+        potrace_word w = 0;
+        int p = i;
+        for (potrace_word m=BM_HIBIT; m; m>>=1) {
+            if (p>=gap) w |= m;
+            if (++p==period) p = 0;
+        }
+        t[i] = w;
+    }
+    return &t;
+}
+
+
+/**
+ * Return the index of the table entry for the first word in a row.
+ */
+int IAStripePattern::startIndex(int y) const
+{
+    long xs = lround(y*pShear + pShift);
+    return positiveMod(-xs, pPeriod);
+}
+
+
+/**
+ * Return true if an entire row of horizontal stripes is a gap.
+ */
+bool IAStripePattern::rowIsGap(int y) const
+{
+    return positiveMod((long)y + pRowPhase, pRowPeriod) < pRowGap;
+}
+
+
+/**
+ * Write the mask for one row into a potrace scanline.
+ *
+ * \param y row number
+ * \param dst receives nWords of mask bits
+ * \param nWords number of words in a scanline
+ */
+void IAStripePattern::row(int y, potrace_word *dst, int nWords) const
+{
+    if (isHorizontal()) {
+        potrace_word w = rowIsGap(y) ? 0 : BM_ALLBITS;
+        for (int i=0; i<nWords; i++) dst[i] = w;
+        return;
+    }
+    const potrace_word *t = pTable->data();
+    int ix = startIndex(y);
+    int step = BM_WORDBITS % pPeriod;
+    for (int i=0; i<nWords; i++) {
+        dst[i] = t[ix];
+        ix += step;
+        if (ix>=pPeriod) ix -= pPeriod;
+    }
+}
+
+
+/**
+ * Logic AND the mask for one row onto a potrace scanline.
+ *
+ * \param y row number
+ * \param row the scanline that will be modified
+ * \param nWords number of words in a scanline
+ */
+void IAStripePattern::andRow(int y, potrace_word *row, int nWords) const
+{
+    if (isHorizontal()) {
+        if (rowIsGap(y)) {
+            for (int i=0; i<nWords; i++) row[i] = 0;
+        }
+        return;
+    }
+    const potrace_word *t = pTable->data();
+    int ix = startIndex(y);
+    int step = BM_WORDBITS % pPeriod;
+    for (int i=0; i<nWords; i++) {
+        row[i] &= t[ix];
+        ix += step;
+        if (ix>=pPeriod) ix -= pPeriod;
+    }
+}
+
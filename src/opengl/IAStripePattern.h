@@ -0,0 +1,66 @@
+//
+//  IAStripePattern.h
+//
+//  Copyright (c) 2013-2018 Matthias Melcher. All rights reserved.
+//
+
+#ifndef IA_STRIPE_PATTERN_H
+#define IA_STRIPE_PATTERN_H
+
+
+#include "potrace/potracelib.h"
+
+#include <vector>
+
+
+/**
+ * A pattern of parallel stripes that is applied to bitmaps one word at a time.
+ *
+ * Stripes are used to turn the core of a layer into lids and infill: every
+ * pixel on a gap is cleared, and the remaining lines are traced. The
+ * pattern repeats along a scanline every `period` pixels. So if a table
+ * holds the word that starts at every possible position within one period,
+ * a whole scanline is masked with one table lookup and one AND per word.
+ * Rows only differ by the position at which the pattern starts.
+ *
+ * Tables depend only on the period and gap along the scanline, and are shared
+ * between all patterns and layers.
+ */
+class IAStripePattern
+{
+public:
+    IAStripePattern(double period, double gap, double angle, double phase=0.0);
+
+    void row(int y, potrace_word *dst, int nWords) const;
+    void andRow(int y, potrace_word *row, int nWords) const;
+
+    /** Return true if all stripes run parallel to the scanlines. */
+    bool isHorizontal() const { return pTable==nullptr; }
+
+    bool rowIsGap(int y) const;
+
+protected:
+    int startIndex(int y) const;
+    static const std::vector<potrace_word> *table(int period, int gap);
+
+    /** Period of the pattern along a scanline in pixels. */
+    int pPeriod = 1;
+
+    /** Number of cleared pixels at the start of each period. */
+    int pGap = 0;
+
+    /** Horizontal offset of the pattern for each row. */
+    double pShear = 0.0;
+
+    /** Horizontal offset of the pattern in row 0. */
+    double pShift = 0.0;
+
+    /** For horizontal stripes: period, gap and phase along the y axis. */
+    int pRowPeriod = 1, pRowGap = 0, pRowPhase = 0;
+
+    /** One word for every starting position within a period; shared and cached. */
+    const std::vector<potrace_word> *pTable = nullptr;
+};
+
+
+#endif /* IA_STRIPE_PATTERN_H */
@@ -0,0 +1,468 @@
+//
+//  IATiledBitmap.cpp
+//
+//  Copyright (c) 2013-2018 Matthias Melcher. All rights reserved.
+//
+
+
+#include "IATiledBitmap.h"
+
+#include "potrace/bitmap.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+
+static const IATiledBitmap::Row kAllBits = ~(IATiledBitmap::Row)0;
+
+
+/**
+ * Read the 64 bits for tile column tx from a potrace scanline.
+ *
+ * Potrace words are 64 bit on most platforms, but only 32 bit on MSWindows.
+ */
+static inline IATiledBitmap::Row readMaskWord(const potrace_word *row, int tx, int nWords)
+{
+    if (BM_WORDBITS==64) {
+        return (IATiledBitmap::Row)row[tx];
+    } else {
+        int i = tx*2;
+        IATiledBitmap::Row hi = (i<nWords) ? (IATiledBitmap::Row)row[i] : 0;
+        IATiledBitmap::Row lo = (i+1<nWords) ? (IATiledBitmap::Row)row[i+1] : 0;
+        return (hi<<32) | (lo & 0xFFFFFFFFUL);
+    }
+}
+
+
+/**
+ * Create an empty tiled bitmap.
+ *
+ * \param w, h size of the bitmap in pixels
+ */
+IATiledBitmap::IATiledBitmap(int w, int h)
+:   pWidth( w ),
+    pHeight( h ),
+    pTilesX( (w+kTileSize-1)/kTileSize ),
+    pTilesY( (h+kTileSize-1)/kTileSize )
+{
+    int n = pTilesX*pTilesY;
+    pState = (uint8_t*)::calloc(n, sizeof(uint8_t));
+    pData = (Row**)::calloc(n, sizeof(Row*));
+}
+
+
+/**
+ * Create a copy of another bitmap.
+ *
+ * Only mixed tiles need to be duplicated.
+ */
+IATiledBitmap::IATiledBitmap(const IATiledBitmap &src)
+:   IATiledBitmap(src.pWidth, src.pHeight)
+{
+    int n = pTilesX*pTilesY;
+    memcpy(pState, src.pState, n*sizeof(uint8_t));
+    for (int i=0; i<n; i++) {
+        if (src.pData[i]) {
+            pData[i] = newTile();
+            memcpy(pData[i], src.pData[i], kTileSize*sizeof(Row));
+        }
+    }
+}
+
+
+/**
+ * Release all tile memory.
+ */
+IATiledBitmap::~IATiledBitmap()
+{
+    int n = pTilesX*pTilesY;
+    for (int i=0; i<n; i++)
+        ::free(pData[i]);
+    for (auto &t: pFreeTiles)
+        ::free(t);
+    ::free(pData);
+    ::free(pState);
+}
+
+
+/**
+ * Get memory for a tile, reusing tiles that were released earlier.
+ */
+IATiledBitmap::Row *IATiledBitmap::newTile()
+{
+    if (pFreeTiles.empty())
+        return (Row*)::malloc(kTileSize*sizeof(Row));
+    Row *t = pFreeTiles.back();
+    pFreeTiles.pop_back();
+    return t;
+}
+
+
+/**
+ * Keep tile memory around for the next tile that becomes mixed.
+ */
+void IATiledBitmap::releaseTile(Row *tile)
+{
+    if (tile) pFreeTiles.push_back(tile);
+}
+
+
+/**
+ * Return a mask of all bits in a tile row that are inside the bitmap.
+ */
+IATiledBitmap::Row IATiledBitmap::validBits(int tx) const
+{
+    int n = pWidth - tx*kTileSize;
+    if (n>=kTileSize) return kAllBits;
+    return kAllBits << (kTileSize-n);
+}
+
+
+/**
+ * Return the number of rows in a tile that are inside the bitmap.
+ */
+int IATiledBitmap::validRows(int ty) const
+{
+    int n = pHeight - ty*kTileSize;
+    return (n>=kTileSize) ? kTileSize : n;
+}
+
+
+/**
+ * Make a tile uniform and release its pixel data.
+ */
+void IATiledBitmap::setUniform(int tx, int ty, TileState s)
+{
+    int i = ty*pTilesX+tx;
+    if (pData[i]) {
+        releaseTile(pData[i]);
+        pData[i] = nullptr;
+    }
+    pState[i] = (uint8_t)s;
+}
+
+
+/**
+ * Make sure that a tile has pixel data and return it.
+ *
+ * A uniform tile is expanded into 64 rows of pixels.
+ */
+IATiledBitmap::Row *IATiledBitmap::materialize(int tx, int ty)
+{
+    int i = ty*pTilesX+tx;
+    Row *t = pData[i];
+    if (!t) {
+        t = pData[i] = newTile();
+        if (pState[i]==FULL) {
+            Row m = validBits(tx);
+            int n = validRows(ty);
+            for (int y=0; y<n; y++) t[y] = m;
+            for (int y=n; y<kTileSize; y++) t[y] = 0;
+        } else {
+            memset(t, 0, kTileSize*sizeof(Row));
+        }
+        pState[i] = MIXED;
+    }
+    return t;
+}
+
+
+/**
+ * Set all pixels in the bitmap, or clear them.
+ *
+ * This only changes the tile flags.
+ */
+void IATiledBitmap::fill(int color)
+{
+    TileState s = color ? FULL : EMPTY;
+    for (int ty=0; ty<pTilesY; ty++)
+        for (int tx=0; tx<pTilesX; tx++)
+            setUniform(tx, ty, s);
+}
+
+
+/**
+ * Return a single pixel.
+ */
+bool IATiledBitmap::get(int x, int y) const
+{
+    if (x<0 || y<0 || x>=pWidth || y>=pHeight) return false;
+    int tx = x/kTileSize, ty = y/kTileSize;
+    switch (tileState(tx, ty)) {
+        case EMPTY: return false;
+        case FULL: return true;
+        default: break;
+    }
+    Row r = tileData(tx, ty)[y%kTileSize];
+    return (r & (((Row)1)<<(kTileSize-1-(x%kTileSize)))) != 0;
+}
+
+
+/**
+ * Set or clear a horizontal run of pixels.
+ *
+ * Tiles that already have the requested color are not touched.
+ *
+ * \param x1 first pixel
+ * \param x2 last pixel plus one
+ * \param y row
+ * \param color 0 to clear pixels, anything else to set them
+ */
+void IATiledBitmap::hline(int x1, int x2, int y, int color)
+{
+    if (y<0 || y>=pHeight) return;
+    if (x1<0) x1 = 0;
+    if (x2>pWidth) x2 = pWidth;
+    if (x1>=x2) return;
+    int ty = y/kTileSize, ry = y%kTileSize;
+    TileState skip = color ? FULL : EMPTY;
+    for (int tx=x1/kTileSize; tx<=(x2-1)/kTileSize; tx++) {
+        if (tileState(tx, ty)==skip) continue;
+        int a = x1 - tx*kTileSize; if (a<0) a = 0;
+        int b = x2 - tx*kTileSize; if (b>kTileSize) b = kTileSize;
+        Row m = (kAllBits>>a) & ~((b<kTileSize) ? (kAllBits>>b) : 0);
+        Row *t = materialize(tx, ty);
+        if (color)
+            t[ry] |= m;
+        else
+            t[ry] &= ~m;
+    }
+}
+
+
+/**
+ * Set or clear all pixels of a single tile.
+ *
+ * \param tx, ty tile index
+ * \param color 0 to clear pixels, anything else to set them
+ */
+void IATiledBitmap::fillTile(int tx, int ty, int color)
+{
+    if (tx<0 || ty<0 || tx>=pTilesX || ty>=pTilesY) return;
+    setUniform(tx, ty, color ? FULL : EMPTY);
+}
+
+
+/**
+ * Logic AND a row of pixels with a mask in potrace scanline format.
+ *
+ * Empty tiles are skipped. This is used to overlay infill patterns.
+ *
+ * \param y row
+ * \param mask a full potrace scanline with at least width() bits
+ */
+void IATiledBitmap::andRow(int y, const potrace_word *mask)
+{
+    if (y<0 || y>=pHeight) return;
+    int ty = y/kTileSize, ry = y%kTileSize;
+    int nWords = (pWidth+BM_WORDBITS-1)/BM_WORDBITS;
+    for (int tx=0; tx<pTilesX; tx++) {
+        if (tileState(tx, ty)==EMPTY) continue;
+        Row m = readMaskWord(mask, tx, nWords);
+        if (m==kAllBits) continue;
+        Row *t = materialize(tx, ty);
+        t[ry] &= m;
+    }
+}
+
+
+/**
+ * Logic AND another bitmap of the same size onto this bitmap.
+ *
+ * Uniform tiles on either side are handled without touching pixel data.
+ */
+void IATiledBitmap::logicAnd(const IATiledBitmap &src)
+{
+    for (int ty=0; ty<pTilesY; ty++) {
+        for (int tx=0; tx<pTilesX; tx++) {
+            TileState d = tileState(tx, ty);
+            TileState s = src.tileState(tx, ty);
+            if (d==EMPTY || s==FULL) {
+                // nothing changes
+            } else if (s==EMPTY) {
+                setUniform(tx, ty, EMPTY);
+            } else if (d==FULL) {
+                Row *t = materialize(tx, ty);
+                memcpy(t, src.tileData(tx, ty), kTileSize*sizeof(Row));
+            } else {
+                Row *t = tileData(tx, ty), *st = src.tileData(tx, ty);
+                Row any = 0;
+                for (int y=0; y<kTileSize; y++)
+                    any |= (t[y] &= st[y]);
+                if (!any) setUniform(tx, ty, EMPTY);
+            }
+        }
+    }
+}
+
+
+/**
+ * Logic AND NOT another bitmap of the same size onto this bitmap.
+ *
+ * Uniform tiles on either side are handled without touching pixel data.
+ */
+void IATiledBitmap::logicAndNot(const IATiledBitmap &src)
+{
+    for (int ty=0; ty<pTilesY; ty++) {
+        for (int tx=0; tx<pTilesX; tx++) {
+            TileState d = tileState(tx, ty);
+            TileState s = src.tileState(tx, ty);
+            if (d==EMPTY || s==EMPTY) {
+                // nothing changes
+            } else if (s==FULL) {
+                setUniform(tx, ty, EMPTY);
+            } else {
+                Row *t = materialize(tx, ty), *st = src.tileData(tx, ty);
+                Row any = 0;
+                for (int y=0; y<kTileSize; y++)
+                    any |= (t[y] &= ~st[y]);
+                if (!any) setUniform(tx, ty, EMPTY);
+            }
+        }
+    }
+}
+
+
+/**
+ * Find mixed tiles that became uniform and release their pixel data.
+ */
+void IATiledBitmap::compact()
+{
+    for (int ty=0; ty<pTilesY; ty++) {
+        int n = validRows(ty);
+        for (int tx=0; tx<pTilesX; tx++) {
+            if (tileState(tx, ty)!=MIXED) continue;
+            Row *t = tileData(tx, ty);
+            Row m = validBits(tx);
+            Row any = 0, all = m;
+            for (int y=0; y<n; y++) {
+                Row r = t[y] & m;
+                any |= r;
+                all &= r;
+            }
+            if (!any)
+                setUniform(tx, ty, EMPTY);
+            else if (all==m)
+                setUniform(tx, ty, FULL);
+        }
+    }
+}
+
+
+/**
+ * Return true if no pixel is set.
+ *
+ * Call compact() first to get an exact result.
+ */
+bool IATiledBitmap::isEmpty() const
+{
+    int n = pTilesX*pTilesY;
+    for (int i=0; i<n; i++)
+        if (pState[i]!=EMPTY) return false;
+    return true;
+}
+
+
+/**
+ * Find the rectangle of tiles that contains all set pixels.
+ *
+ * \param[out] x0, y0 bottom left pixel of the area
+ * \param[out] x1, y1 top right pixel of the area plus one
+ * \return false if the bitmap is empty
+ */
+bool IATiledBitmap::contentBounds(int &x0, int &y0, int &x1, int &y1) const
+{
+    int tx0 = pTilesX, ty0 = pTilesY, tx1 = -1, ty1 = -1;
+    for (int ty=0; ty<pTilesY; ty++) {
+        for (int tx=0; tx<pTilesX; tx++) {
+            if (tileState(tx, ty)==EMPTY) continue;
+            if (tx<tx0) tx0 = tx;
+            if (tx>tx1) tx1 = tx;
+            if (ty<ty0) ty0 = ty;
+            ty1 = ty;
+        }
+    }
+    if (tx1<0) return false;
+    x0 = tx0*kTileSize; x1 = (tx1+1)*kTileSize; if (x1>pWidth) x1 = pWidth;
+    y0 = ty0*kTileSize; y1 = (ty1+1)*kTileSize; if (y1>pHeight) y1 = pHeight;
+    return true;
+}
+
+
+/**
+ * Copy a rectangle of pixels into a potrace bitmap.
+ *
+ * \param bm destination bitmap; its size defines the size of the rectangle
+ * \param x0, y0 position of the rectangle in this bitmap
+ */
+void IATiledBitmap::copyToBitmap(potrace_bitmap_t *bm, int x0, int y0) const
+{
+    int dy = bm->dy;
+    int lastBits = bm->w % BM_WORDBITS;
+    potrace_word lastMask = lastBits ? ~(BM_ALLBITS >> lastBits) : BM_ALLBITS;
+    for (int y=0; y<bm->h; y++) {
+        potrace_word *dst = bm_scanline(bm, y);
+        int sy = y+y0;
+        if (sy<0 || sy>=pHeight) {
+            memset(dst, 0, dy*sizeof(potrace_word));
+            continue;
+        }
+        int ty = sy/kTileSize, ry = sy%kTileSize;
+        for (int i=0; i<dy; i++) {
+            // gather BM_WORDBITS pixels, starting at pixel sx
+            int sx = x0 + i*BM_WORDBITS;
+            potrace_word w = 0;
+            for (int k=0; k<BM_WORDBITS; ) {
+                int x = sx+k;
+                if (x>=pWidth) break;
+                int tx = x/kTileSize, bx = x%kTileSize;
+                int n = kTileSize-bx; if (n>BM_WORDBITS-k) n = BM_WORDBITS-k;
+                Row r;
+                switch (tileState(tx, ty)) {
+                    case EMPTY: r = 0; break;
+                    case FULL: r = validBits(tx); break;
+                    default: r = tileData(tx, ty)[ry]; break;
+                }
+                // the n bits starting at bx, moved to the top of the row word
+                r = (r << bx) & ~(n<kTileSize ? (kAllBits >> n) : 0);
+                w |= (potrace_word)(r >> (kTileSize-BM_WORDBITS+k));
+                k += n;
+            }
+            dst[i] = w;
+        }
+        dst[dy-1] &= lastMask;
+    }
+}
+
+
+/**
+ * Replace all pixels with the content of a potrace bitmap of the same size.
+ */
+void IATiledBitmap::copyFromBitmap(const potrace_bitmap_t *bm)
+{
+    int nWords = bm->dy < 0 ? -bm->dy : bm->dy;
+    for (int ty=0; ty<pTilesY; ty++) {
+        int n = validRows(ty);
+        for (int tx=0; tx<pTilesX; tx++) {
+            Row *t = materialize(tx, ty);
+            Row m = validBits(tx);
+            for (int y=0; y<n; y++)
+                t[y] = readMaskWord(bm_scanline(bm, ty*kTileSize+y), tx, nWords) & m;
+            for (int y=n; y<kTileSize; y++)
+                t[y] = 0;
+        }
+    }
+    compact();
+}
+
+
+/**
+ * Return the number of bytes used by the pixel data of this bitmap.
+ */
+size_t IATiledBitmap::memoryUsage() const
+{
+    size_t n = 0;
+    for (int i=0; i<pTilesX*pTilesY; i++)
+        if (pData[i]) n += kTileSize*sizeof(Row);
+    return n + pTilesX*pTilesY*(sizeof(uint8_t)+sizeof(Row*));
+}
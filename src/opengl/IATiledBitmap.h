@@ -0,0 +1,111 @@
+//
+//  IATiledBitmap.h
+//
+//  Copyright (c) 2013-2018 Matthias Melcher. All rights reserved.
+//
+
+#ifndef IA_TILED_BITMAP_H
+#define IA_TILED_BITMAP_H
+
+
+#include "potrace/potracelib.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+
+/**
+ * A sparse one bit per pixel image, split into square tiles of 64x64 pixels.
+ *
+ * Most layers of thin walled or lattice structures are empty, or completely
+ * filled in large areas. Tiles that contain only zeros or only ones are
+ * stored as a flag and need no pixel memory at all. Only tiles that contain
+ * a mix of set and cleared pixels allocate 64 rows of 64 bits.
+ *
+ * Boolean operations and fills check the flags first and skip the pixel data
+ * whenever one of the operands is uniform.
+ *
+ * Pixels are stored in the same order as potrace bitmaps: the leftmost pixel
+ * of a tile row is the most significant bit of the row word.
+ */
+class IATiledBitmap
+{
+public:
+    /** Width and height of a tile in pixels. */
+    static const int kTileSize = 64;
+
+    /** One row of pixels in a tile. */
+    typedef uint64_t Row;
+
+    /** Tiles are either uniform, or they store all of their pixels. */
+    typedef enum {
+        EMPTY = 0,
+        FULL,
+        MIXED
+    } TileState;
+
+    IATiledBitmap(int w, int h);
+    IATiledBitmap(const IATiledBitmap&);
+    ~IATiledBitmap();
+    IATiledBitmap &operator=(const IATiledBitmap&) = delete;
+
+    /** Width in pixels. */
+    int width() const { return pWidth; }
+
+    /** Height in pixels. */
+    int height() const { return pHeight; }
+
+    /** Number of tiles in a row. */
+    int tilesX() const { return pTilesX; }
+
+    /** Number of rows of tiles. */
+    int tilesY() const { return pTilesY; }
+
+    /** Return the state of a single tile. */
+    TileState tileState(int tx, int ty) const { return (TileState)pState[ty*pTilesX+tx]; }
+
+    void fill(int color);
+    bool get(int x, int y) const;
+    void hline(int x1, int x2, int y, int color);
+    void fillTile(int tx, int ty, int color);
+    void andRow(int y, const potrace_word *mask);
+
+    void logicAnd(const IATiledBitmap &src);
+    void logicAndNot(const IATiledBitmap &src);
+
+    void compact();
+    bool isEmpty() const;
+    bool contentBounds(int &x0, int &y0, int &x1, int &y1) const;
+
+    void copyToBitmap(potrace_bitmap_t *bm, int x0, int y0) const;
+    void copyFromBitmap(const potrace_bitmap_t *bm);
+
+    size_t memoryUsage() const;
+
+protected:
+    Row *tileData(int tx, int ty) const { return pData[ty*pTilesX+tx]; }
+    Row *materialize(int tx, int ty);
+    void setUniform(int tx, int ty, TileState s);
+    Row validBits(int tx) const;
+    int validRows(int ty) const;
+    Row *newTile();
+    void releaseTile(Row *tile);
+
+    int pWidth = 0;
+    int pHeight = 0;
+    int pTilesX = 0;
+    int pTilesY = 0;
+
+    /** One TileState per tile, row by row. */
+    uint8_t *pState = nullptr;
+
+    /** Pixel data for MIXED tiles, nullptr for uniform tiles. */
+    Row **pData = nullptr;
+
+    /** Tile memory that can be reused without calling the allocator. */
+    std::vector<Row*> pFreeTiles;
+};
+
+
+#endif /* IA_TILED_BITMAP_H */
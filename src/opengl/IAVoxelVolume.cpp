@@ -0,0 +1,102 @@
+//
+//  IAVoxelVolume.cpp
+//
+//  Copyright (c) 2013-2018 Matthias Melcher. All rights reserved.
+//
+
+
+#include "IAVoxelVolume.h"
+
+#include "opengl/IAFramebuffer.h"
+#include "potrace/bitmap.h"
+
+
+/**
+ * Create an empty volume.
+ *
+ * \param w, h size of every layer in pixels
+ * \param n number of layers above and below that make a pixel solid
+ */
+IAVoxelVolume::IAVoxelVolume(int w, int h, int n)
+:   pWidth( w ),
+    pHeight( h ),
+    pWords( w==0 ? 0 : (w-1)/BM_WORDBITS+1 ),
+    pRange( n )
+{
+    int k = 2*n+1;
+    while (k>>pBits) pBits++;
+    pPlane.resize(pBits);
+    for (auto &p: pPlane)
+        p.assign((size_t)pWords*pHeight, 0);
+    pRow.resize(pWords);
+}
+
+
+IAVoxelVolume::~IAVoxelVolume()
+{
+}
+
+
+/**
+ * Add the next layer on top of the volume.
+ *
+ * Every counter is incremented where the layer is set, saturating at 2n+1,
+ * and reset where it is not.
+ *
+ * \param core the core bitmap of the layer, or nullptr for an empty layer
+ */
+void IAVoxelVolume::addLayer(IAFramebuffer *core)
+{
+    const int k = 2*pRange+1;
+    const int nb = pBits;
+    potrace_word *plane[32];
+    for (int y=0; y<pHeight; y++) {
+        if (core)
+            core->readRow(y, pRow.data());
+        else
+            memset(pRow.data(), 0, pWords*sizeof(potrace_word));
+        for (int b=0; b<nb; b++)
+            plane[b] = pPlane[b].data() + (size_t)y*pWords;
+        for (int i=0; i<pWords; i++) {
+            potrace_word set = pRow[i];
+            // lanes that already reached 2n+1 stay there
+            potrace_word full = BM_ALLBITS;
+            for (int b=0; b<nb; b++)
+                full &= ((k>>b)&1) ? plane[b][i] : ~plane[b][i];
+            potrace_word carry = set & ~full;
+            for (int b=0; b<nb; b++) {
+                potrace_word w = plane[b][i];
+                potrace_word c = w & carry;
+                plane[b][i] = (w ^ carry) & set;
+                carry = c;
+            }
+        }
+    }
+    pLayers++;
+}
+
+
+/**
+ * Write the solid pixels of the layer that was added n layers ago.
+ *
+ * \param dst a bitmap of the same size as the volume
+ */
+void IAVoxelVolume::solidMask(potrace_bitmap_t *dst) const
+{
+    const int k = 2*pRange+1;
+    const int nb = pBits;
+    int lastBits = pWidth % BM_WORDBITS;
+    potrace_word lastMask = lastBits ? ~(BM_ALLBITS >> lastBits) : BM_ALLBITS;
+    for (int y=0; y<pHeight; y++) {
+        potrace_word *d = bm_scanline(dst, y);
+        size_t o = (size_t)y*pWords;
+        for (int i=0; i<pWords; i++) {
+            potrace_word full = BM_ALLBITS;
+            for (int b=0; b<nb; b++)
+                full &= ((k>>b)&1) ? pPlane[b][o+i] : ~pPlane[b][o+i];
+            d[i] = full;
+        }
+        if (pWords) d[pWords-1] &= lastMask;
+    }
+}
+
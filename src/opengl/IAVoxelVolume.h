@@ -0,0 +1,69 @@
+//
+//  IAVoxelVolume.h
+//
+//  Copyright (c) 2013-2018 Matthias Melcher. All rights reserved.
+//
+
+#ifndef IA_VOXEL_VOLUME_H
+#define IA_VOXEL_VOLUME_H
+
+
+#include "potrace/potracelib.h"
+
+#include <vector>
+
+
+class IAFramebuffer;
+
+
+/**
+ * A bit packed stack of layers that finds the solid interior of a model.
+ *
+ * A pixel is solid in layer i, if it is set in all layers from i-n to i+n.
+ * Everything else in the core of layer i is a lid or a bottom. Instead of
+ * ANDing 2n layers for every layer, every pixel keeps a count of the
+ * consecutive layers it was set in, up to 2n+1. The counts are stored bit
+ * sliced, so one word holds one bit of the count for a whole group of
+ * pixels, and all counts are updated with a few logic operations per word.
+ *
+ * Layers are added bottom to top in one pass. After adding layer i+n, the
+ * solid mask of layer i is available. The cost per layer does not depend
+ * on the number of lids.
+ */
+class IAVoxelVolume
+{
+public:
+    IAVoxelVolume(int w, int h, int n);
+    ~IAVoxelVolume();
+
+    void addLayer(IAFramebuffer *core);
+    void solidMask(potrace_bitmap_t *dst) const;
+
+    /** Number of layers that were added so far. */
+    int layers() const { return pLayers; }
+
+protected:
+    int pWidth = 0;
+    int pHeight = 0;
+
+    /** Number of words in a scanline. */
+    int pWords = 0;
+
+    /** Number of layers that must be set above and below a solid pixel. */
+    int pRange = 0;
+
+    /** Number of bits needed to count up to 2n+1. */
+    int pBits = 0;
+
+    /** Number of layers added so far. */
+    int pLayers = 0;
+
+    /** Bit k of all pixel counters, pWords*pHeight words per plane. */
+    std::vector<std::vector<potrace_word> > pPlane;
+
+    /** One scanline of the layer that is currently added. */
+    std::vector<potrace_word> pRow;
+};
+
+
+#endif /* IA_VOXEL_VOLUME_H */
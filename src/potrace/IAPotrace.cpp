@@ -7,8 +7,10 @@
 #include "IAPotrace.h"
 
 #include "Iota.h"
+#include "app/IAThreadPool.h"
 #include "toolpath/IAToolpath.h"
 #include "opengl/IAFramebuffer.h"
+#include "opengl/IAComponentLabeler.h"
 #include "printer/IAPrinter.h"
 
 #ifdef HAVE_CONFIG_H
@@ -21,6 +23,9 @@
 #include <stdlib.h>
 #include <math.h>
 
+#include <atomic>
+#include <vector>
+
 #include "potracelib.h"
 #include "bitmap.h"
 
@@ -70,66 +75,157 @@
 //    free(bm);
 //}
 
-void bezier(IAToolpath *toolpath,
-            double x1, double y1,
-            double x2, double y2,
-            double x3, double y3,
-            double x4, double y4);
+/**
+ * A bitmap whose memory is kept from one trace to the next.
+ *
+ * The memory only grows, so after the first layer, tracing does not
+ * allocate any more bitmaps.
+ */
+class IAScratchBitmap
+{
+public:
+    /** Return the bitmap with the given size; the content is undefined. */
+    potrace_bitmap_t *resize(int w, int h) {
+        int dy = (w+BM_WORDBITS-1)/BM_WORDBITS;
+        size_t n = (size_t)dy*h;
+        if (pMap.size()<n) pMap.resize(n);
+        pBitmap.w = w;
+        pBitmap.h = h;
+        pBitmap.dy = dy;
+        pBitmap.map = pMap.data();
+        return &pBitmap;
+    }
+private:
+    potrace_bitmap_t pBitmap = { 0, 0, 0, nullptr };
+    std::vector<potrace_word> pMap;
+};
+
+
+/** The area that is traced, and the working copy that potrace destroys; one pair per thread */
+static thread_local IAScratchBitmap gTraceSource, gTraceWork;
 
 
 /**
- * Trace the given framebuffer and store the result as a toolpath at layer z.
+ * The memory for potrace's paths and curves on one thread.
  *
- * \todo It may be useful to choose a component, r, g, b, or a, and a threshold
- * \todo Conversion to bitmap is expensive. Can't we rewrite that to use bytes?
- * \todo Not handling holes, not handling hierarchies of loops
- * \todo don't render noise specs
- *       http://potrace.sourceforge.net/potracelib.pdf
+ * potrace would otherwise allocate and free several small arrays for every
+ * path. The arena is reused by every trace on the same thread, and freed
+ * when the thread ends.
  */
-int potrace(IAFramebuffer *framebuffer, IAToolpathList *toolpath, double z)
+class IATraceArena
 {
-    int width = framebuffer->width();
-    int height = framebuffer->height();
+public:
+    ~IATraceArena() { potrace_arena_free(pArena); }
+    potrace_arena_t *get() {
+        if (!pArena) pArena = potrace_arena_new();
+        return pArena;
+    }
+private:
+    potrace_arena_t *pArena = nullptr;
+};
+
+
+static thread_local IATraceArena gTraceArena;
+
+
+/** The points of the loop that is currently built, as x, y pairs; one buffer per thread */
+static thread_local std::vector<double> gLoopPoints;
 
-    IAVector3d &printbed = Iota.pCurrentPrinter->pPrintVolume;
-    double xScl = printbed.x()/width;
-    double yScl = printbed.y()/height;
 
-    int x, y, i;
-    potrace_bitmap_t *bm;
+/** Cubic curves are never split into more than 2^kMaxBezierDepth segments */
+static const int kMaxBezierDepth = 10;
+
+
+/**
+ * Return the distance of a point from a line segment.
+ */
+static double distance(double px, double py, double ax, double ay, double bx, double by)
+{
+    double dx = bx-ax, dy = by-ay;
+    double len2 = dx*dx + dy*dy;
+    double t = len2>0.0 ? ((px-ax)*dx + (py-ay)*dy)/len2 : 0.0;
+    if (t<0.0) t = 0.0; else if (t>1.0) t = 1.0;
+    double ex = ax+t*dx-px, ey = ay+t*dy-py;
+    return sqrt(ex*ex + ey*ey);
+}
+
+
+/**
+ * Append a cubic Bezier curve as a list of points.
+ *
+ * The curve is split in half until both control points are within the
+ * tolerance of the chord. A curve always stays inside the hull of its
+ * control points, so the segments are within the tolerance of the curve.
+ * Halves wait on a small stack instead of recursing, and the number of
+ * splits is limited.
+ *
+ * The start point is not appended; the end point always is.
+ *
+ * \param dst append x, y pairs here
+ * \param c the four control points as x, y pairs
+ * \param tolerance maximum distance between the curve and the segments
+ *
+ * \see http://www.antigrain.com/research/adaptive_bezier/index.html
+ */
+static void flattenBezier(std::vector<double> &dst, const double c[8], double tolerance)
+{
+    struct Curve { double p[8]; int depth; };
+    Curve stack[kMaxBezierDepth+1];
+    int n = 0;
+    stack[n] = { { c[0], c[1], c[2], c[3], c[4], c[5], c[6], c[7] }, 0 };
+    n++;
+    while (n>0) {
+        const Curve cv = stack[--n];
+        const double *p = cv.p;
+        if (cv.depth>=kMaxBezierDepth
+            || (   distance(p[2], p[3], p[0], p[1], p[6], p[7])<=tolerance
+                && distance(p[4], p[5], p[0], p[1], p[6], p[7])<=tolerance))
+        {
+            dst.push_back(p[6]);
+            dst.push_back(p[7]);
+            continue;
+        }
+        // split at t=0.5
+        double x12   = (p[0]+p[2])/2, y12   = (p[1]+p[3])/2;
+        double x23   = (p[2]+p[4])/2, y23   = (p[3]+p[5])/2;
+        double x34   = (p[4]+p[6])/2, y34   = (p[5]+p[7])/2;
+        double x123  = (x12+x23)/2,   y123  = (y12+y23)/2;
+        double x234  = (x23+x34)/2,   y234  = (y23+y34)/2;
+        double x1234 = (x123+x234)/2, y1234 = (y123+y234)/2;
+        // the second half goes on the stack first, so the first half is output first
+        stack[n++] = { { x1234, y1234, x234, y234, x34, y34, p[6], p[7] }, cv.depth+1 };
+        stack[n++] = { { p[0], p[1], x12, y12, x123, y123, x1234, y1234 }, cv.depth+1 };
+    }
+}
+
+
+/**
+ * Trace a bitmap and add a loop for every path to the toolpath.
+ *
+ * \param bm the bitmap is not modified; potrace works on a scratch copy
+ * \param toolpath add all loops to this list
+ * \param z give all segments in the toolpath a z position
+ * \param xScl, yScl size of a pixel in world space
+ * \param xOff, yOff position of the bitmap origin in world space
+ * \param tolerance curves are flattened to this distance in world space
+ *
+ * \return 0 on success
+ */
+static int traceBitmap(potrace_bitmap_t *bm, IAToolpathList *toolpath, double z,
+                       double xScl, double yScl, double xOff, double yOff,
+                       double tolerance)
+{
+    int i;
     potrace_param_t *param;
     potrace_path_t *p;
     potrace_state_t *st;
     int n, *tag;
     potrace_dpoint_t (*c)[3];
 
-    /* create a bitmap */
-    if (framebuffer->pBitmap) {
-        bm = bm_dup(framebuffer->pBitmap);
-    } else {
-        const uint8_t *px = framebuffer->getRawImageRGB();
-        bm = bm_new(width, height);
-        if (!bm) {
-            fprintf(stderr, "Error allocating bitmap: %s\n", strerror(errno));
-            ::free((void*)px);
-            return 1;
-        }
-
-        /* fill the bitmap with some pattern */
-        for (y=0; y<height; y++) {
-            for (x=0; x<width; x++) {
-                unsigned char r = px[ (x+width*y)*3 ];
-                BM_PUT(bm, x, y, r>128 ? 1 : 0);
-            }
-        }
-        ::free((void*)px);
-    }
-
     /* set tracing parameters, starting from defaults */
     param = potrace_param_default();
     if (!param) {
         fprintf(stderr, "Error allocating parameters: %s\n", strerror(errno));
-        bm_free(bm);
         return 1;
     }
 
@@ -152,66 +248,49 @@ int potrace(IAFramebuffer *framebuffer, IAToolpathList *toolpath, double z)
     param->opttolerance = 0.2;
 
     /* trace the bitmap */
-//    bm->w = width/2;
-//    bm->map +=32;
-    st = potrace_trace(param, bm);
-//    bm->w = width;
-//    bm->map -=32;
+    st = potrace_trace_scratch(param, bm, gTraceWork.resize(bm->w, bm->h), gTraceArena.get());
 
     if (!st || st->status != POTRACE_STATUS_OK) {
         fprintf(stderr, "Error tracing bitmap: %s\n", strerror(errno));
+        potrace_param_free(param);
         return 1;
     }
-    bm_free(bm);
 
-    IAToolpathLoop *toolpathLoop = nullptr;
-    /* draw each curve */
-    p = st->plist;
-    while (p != NULL) {
+    /* convert each path into a loop */
+    std::vector<double> &pts = gLoopPoints;
+    for (p = st->plist; p; p = p->next) {
         n = p->curve.n;
         tag = p->curve.tag;
         c = p->curve.c;
-        if (!toolpathLoop) {
-            toolpathLoop = new IAToolpathLoop(z);
-            toolpathLoop->startPath(c[n-1][2].x*xScl, c[n-1][2].y*yScl);
-        } else {
-            toolpathLoop->continuePath(c[n-1][2].x*xScl, c[n-1][2].y*yScl);
-        }
+        pts.clear();
+        pts.push_back(c[n-1][2].x*xScl+xOff);
+        pts.push_back(c[n-1][2].y*yScl+yOff);
         for (i=0; i<n; i++) {
-            int j;
             switch (tag[i]) {
                 case POTRACE_CORNER:
-                    toolpathLoop->continuePath(c[i][1].x*xScl, c[i][1].y*yScl);
-                    toolpathLoop->continuePath(c[i][2].x*xScl, c[i][2].y*yScl);
-                    break;
-                case POTRACE_CURVETO:
-#if 0
-                    toolpathLoop->continuePath(c[i][0].x*xScl, c[i][0].y*yScl);
-                    toolpathLoop->continuePath(c[i][1].x*xScl, c[i][1].y*yScl);
-                    toolpathLoop->continuePath(c[i][2].x*xScl, c[i][2].y*yScl);
-#else
-                    j = i ? i-1 : n-1;
-                    bezier(toolpathLoop,
-                           c[j][2].x*xScl, c[j][2].y*yScl,
-                           c[i][0].x*xScl, c[i][0].y*yScl,
-                           c[i][1].x*xScl, c[i][1].y*yScl,
-                           c[i][2].x*xScl, c[i][2].y*yScl);
-#endif
+                    pts.push_back(c[i][1].x*xScl+xOff);
+                    pts.push_back(c[i][1].y*yScl+yOff);
+                    pts.push_back(c[i][2].x*xScl+xOff);
+                    pts.push_back(c[i][2].y*yScl+yOff);
                     break;
+                case POTRACE_CURVETO: {
+                    // the curve starts where the previous segment ended
+                    double b[8] = {
+                        pts[pts.size()-2], pts[pts.size()-1],
+                        c[i][0].x*xScl+xOff, c[i][0].y*yScl+yOff,
+                        c[i][1].x*xScl+xOff, c[i][1].y*yScl+yOff,
+                        c[i][2].x*xScl+xOff, c[i][2].y*yScl+yOff };
+                    flattenBezier(pts, b, tolerance);
+                    break; }
                 default:
                     printf("potrace: unknown tag %d\n", tag[i]);
             }
         }
-        /* at the end of a group of a positive path and its negative
-         children, fill. */
-        //if (p->next == NULL || p->next->sign == '+') {
-            // NULL-> close path and quit layer?
-            // + -> rapid move to next shape
-            toolpathLoop->closePath();
-            toolpath->add(toolpathLoop, 0, 0, 0);
-            toolpathLoop = nullptr;
-        //}
-        p = p->next;
+        IAToolpathLoop *toolpathLoop = new IAToolpathLoop(z);
+        toolpathLoop->startPath(pts[0], pts[1]);
+        toolpathLoop->continuePath(pts.data()+2, pts.size()/2-1);
+        toolpathLoop->closePath();
+        toolpath->add(toolpathLoop, 0, 0, 0);
     }
 
     potrace_state_free(st);
@@ -221,58 +300,89 @@ int potrace(IAFramebuffer *framebuffer, IAToolpathList *toolpath, double z)
 }
 
 
-static const double m_distance_tolerance = 0.01;
-
-// http://www.antigrain.com/research/adaptive_bezier/index.html
-void recursive_bezier(IAToolpath *tp,
-                      double x1, double y1,
-                      double x2, double y2,
-                      double x3, double y3,
-                      double x4, double y4)
+/**
+ * Trace all components of a bitmap in parallel.
+ *
+ * Every component is copied into the scratch bitmap of its thread and
+ * traced on its own. Components are 8-connected, so no path of potrace
+ * crosses from one component into another, and the loops are the same as
+ * if the entire bitmap was traced. The loops are added in the order of the
+ * components, no matter which thread finished first.
+ *
+ * The threads come from the shared IAThreadPool, so they keep their scratch
+ * bitmaps and arenas from one trace to the next.
+ *
+ * \return 0 on success
+ */
+static int traceComponents(const IAComponentLabeler *components, IAToolpathList *toolpath,
+                           double z, double xScl, double yScl, double tolerance,
+                           int nThreads)
 {
-    // Calculate all the mid-points of the line segments
-    //----------------------
-    double x12   = (x1 + x2) / 2;
-    double y12   = (y1 + y2) / 2;
-    double x23   = (x2 + x3) / 2;
-    double y23   = (y2 + y3) / 2;
-    double x34   = (x3 + x4) / 2;
-    double y34   = (y3 + y4) / 2;
-    double x123  = (x12 + x23) / 2;
-    double y123  = (y12 + y23) / 2;
-    double x234  = (x23 + x34) / 2;
-    double y234  = (y23 + y34) / 2;
-    double x1234 = (x123 + x234) / 2;
-    double y1234 = (y123 + y234) / 2;
-
-    // Try to approximate the full cubic curve by a single straight line
-    //------------------
-    double dx = x4-x1;
-    double dy = y4-y1;
-
-    double d2 = fabs(((x2 - x4) * dy - (y2 - y4) * dx));
-    double d3 = fabs(((x3 - x4) * dy - (y3 - y4) * dx));
-
-    if((d2 + d3)*(d2 + d3) < m_distance_tolerance * (dx*dx + dy*dy))
-    {
-        tp->continuePath(x1234, y1234);
-        return;
-    }
+    const auto &comp = components->components();
+    int n = (int)comp.size();
+    std::vector<IAToolpathList*> result(n, nullptr);
+    std::atomic<int> next(0);
+    std::atomic<int> err(0);
+
+    auto worker = [&]() {
+        for (;;) {
+            int i = next++;
+            if (i>=n) break;
+            const IAComponentLabeler::Component &cp = comp[i];
+            potrace_bitmap_t *bm = gTraceSource.resize(cp.pXMax-cp.pXMin, cp.pYMax-cp.pYMin);
+            bm_clear(bm, 0);
+            components->drawComponent(i, bm, cp.pXMin, cp.pYMin);
+            result[i] = new IAToolpathList(z);
+            if (traceBitmap(bm, result[i], z, xScl, yScl, cp.pXMin*xScl, cp.pYMin*yScl, tolerance))
+                err = 1;
+        }
+    };
 
-    // Continue subdivision
-    //----------------------
-    recursive_bezier(tp, x1, y1, x12, y12, x123, y123, x1234, y1234);
-    recursive_bezier(tp, x1234, y1234, x234, y234, x34, y34, x4, y4);
+    if (nThreads>n) nThreads = n;
+    IAThreadPool::shared().run(nThreads, worker);
+
+    for (auto &tp: result) {
+        if (tp) {
+            toolpath->move(tp);
+            delete tp;
+        }
+    }
+    return err;
 }
 
 
-void bezier(IAToolpath *tp,
-            double x1, double y1,
-            double x2, double y2,
-            double x3, double y3,
-            double x4, double y4)
+/**
+ * Trace the given framebuffer and store the result as a toolpath at layer z.
+ *
+ * Only the rectangle that contains set pixels is copied and traced.
+ *
+ * \param components if the connected components of a BITMAP or TILED buffer
+ *      were already found, they are traced in parallel
+ *
+ * \todo It may be useful to choose a component, r, g, b, or a, and a threshold
+ * \todo Not handling holes, not handling hierarchies of loops
+ *       http://potrace.sourceforge.net/potracelib.pdf
+ */
+int potrace(IAFramebuffer *framebuffer, IAToolpathList *toolpath, double z,
+            const IAComponentLabeler *components)
 {
-    //add_point(x1, y1);
-    recursive_bezier(tp, x1, y1, x2, y2, x3, y3, x4, y4);
-    tp->continuePath(x4, y4);
+    int width = framebuffer->width();
+    int height = framebuffer->height();
+
+    IAVector3d &printbed = Iota.pCurrentPrinter->pPrintVolume;
+    double xScl = printbed.x()/width;
+    double yScl = printbed.y()/height;
+
+    double tolerance = Iota.pCurrentPrinter->curveTolerance();
+
+    int nThreads = Iota.pCurrentPrinter->numTraceThreads();
+    if (components && nThreads>1 && components->components().size()>1)
+        return traceComponents(components, toolpath, z, xScl, yScl, tolerance, nThreads);
+
+    int x0, y0, x1, y1;
+    if (!framebuffer->contentBounds(x0, y0, x1, y1))
+        return 0;
+    potrace_bitmap_t *bm = gTraceSource.resize(x1-x0, y1-y0);
+    framebuffer->copyToBitmap(bm, x0, y0);
+    return traceBitmap(bm, toolpath, z, xScl, yScl, x0*xScl, y0*yScl, tolerance);
 }
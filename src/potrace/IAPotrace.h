@@ -10,9 +10,11 @@
 
 class IAFramebuffer;
 class IAToolpathList;
+class IAComponentLabeler;
 
 
-int potrace(IAFramebuffer *framebuffer, IAToolpathList *toolpath, double z);
+int potrace(IAFramebuffer *framebuffer, IAToolpathList *toolpath, double z,
+            const IAComponentLabeler *components=nullptr);
 
 
 #endif /* IA_POTRACE_H */
@@ -0,0 +1,192 @@
+/* Copyright (C) 2013-2018 Matthias Melcher.
+   This file is part of the Potrace integration of Iota. It is covered
+   by the GNU General Public License. See the file COPYING for details. */
+
+/* bump allocation of path and curve data, see potrace_trace_scratch() */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#if defined(_MSC_VER)
+#define ARENA_THREAD_LOCAL __declspec(thread)
+#else
+#define ARENA_THREAD_LOCAL __thread
+#endif
+
+/* allocations are aligned to this many bytes */
+#define ARENA_ALIGN 16
+/* smallest block that is taken from the C library */
+#define ARENA_BLOCK_SIZE (256*1024)
+
+struct arena_block_s {
+  arena_block_t *next;
+  size_t size;  /* bytes of data after the header */
+  size_t used;  /* bytes that were handed out */
+};
+
+/* the data follows the header, aligned */
+#define block_data(b) ((char *)(b) + align(sizeof(arena_block_t)))
+
+/* the arena of the trace that is running on this thread, or NULL */
+static ARENA_THREAD_LOCAL potrace_arena_t *current = NULL;
+
+static size_t align(size_t size) {
+  return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+/* return uninitialized memory from the arena, or NULL on error */
+static void *arena_alloc(arena_t *a, size_t size) {
+  arena_block_t *b;
+  void *p;
+
+  size = align(size);
+  /* blocks after the current one are empty since the last reset */
+  for (b = a->cur; b; b = b->next) {
+    if (b->size - b->used >= size) {
+      break;
+    }
+  }
+  if (!b) {
+    size_t bsize = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+    b = (arena_block_t *)malloc(align(sizeof(arena_block_t)) + bsize);
+    if (!b) {
+      return NULL;
+    }
+    b->next = NULL;
+    b->size = bsize;
+    b->used = 0;
+    if (a->cur) {
+      while (a->cur->next) {
+	a->cur = a->cur->next;
+      }
+      a->cur->next = b;
+    } else {
+      a->first = b;
+    }
+  }
+  a->cur = b;
+  p = block_data(b) + b->used;
+  b->used += size;
+  return p;
+}
+
+/* give back all memory of an arena, but keep the blocks */
+static void arena_reset(arena_t *a) {
+  arena_block_t *b;
+
+  for (b = a->first; b; b = b->next) {
+    b->used = 0;
+  }
+  a->cur = a->first;
+}
+
+/* free all blocks of an arena */
+static void arena_release(arena_t *a) {
+  arena_block_t *b, *next;
+
+  for (b = a->first; b; b = next) {
+    next = b->next;
+    free(b);
+  }
+  a->first = a->cur = NULL;
+}
+
+void *arena_calloc(size_t n, size_t size) {
+  void *p;
+
+  if (!current) {
+    return calloc(n, size);
+  }
+  p = arena_alloc(&current->data, n * size);
+  if (p) {
+    memset(p, 0, n * size);
+  }
+  return p;
+}
+
+void *arena_scratch_calloc(size_t n, size_t size) {
+  void *p;
+
+  if (!current) {
+    return calloc(n, size);
+  }
+  p = arena_alloc(&current->scratch, n * size);
+  if (p) {
+    memset(p, 0, n * size);
+  }
+  return p;
+}
+
+/* resize memory from arena_calloc(). If p was the last allocation, it
+   grows in place. */
+void *arena_realloc(void *p, size_t oldsize, size_t newsize) {
+  arena_block_t *b;
+  void *p1;
+
+  if (!current) {
+    return realloc(p, newsize);
+  }
+  b = current->data.cur;
+  if (p && b && (char *)p + align(oldsize) == block_data(b) + b->used
+      && (size_t)((char *)p - block_data(b)) + align(newsize) <= b->size) {
+    b->used = (size_t)((char *)p - block_data(b)) + align(newsize);
+    return p;
+  }
+  p1 = arena_alloc(&current->data, newsize);
+  if (p1 && p) {
+    memcpy(p1, p, oldsize < newsize ? oldsize : newsize);
+  }
+  return p1;
+}
+
+void arena_free(void *p) {
+  if (!current) {
+    free(p);
+  }
+}
+
+/* release all temporary memory of the current path */
+void arena_scratch_reset(void) {
+  if (current) {
+    arena_reset(&current->scratch);
+  }
+}
+
+/* start a trace that allocates from the given arena, or from the C
+   library if a is NULL. All memory of the previous trace with the same
+   arena is given back. */
+potrace_arena_t *arena_enter(potrace_arena_t *a) {
+  potrace_arena_t *prev = current;
+
+  if (a) {
+    arena_reset(&a->data);
+    arena_reset(&a->scratch);
+  }
+  current = a;
+  return prev;
+}
+
+void arena_leave(potrace_arena_t *prev) {
+  current = prev;
+}
+
+/* ---------------------------------------------------------------------- */
+/* API functions */
+
+potrace_arena_t *potrace_arena_new(void) {
+  return (potrace_arena_t *)calloc(1, sizeof(potrace_arena_t));
+}
+
+void potrace_arena_free(potrace_arena_t *a) {
+  if (a) {
+    arena_release(&a->data);
+    arena_release(&a->scratch);
+  }
+  free(a);
+}
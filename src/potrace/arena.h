@@ -0,0 +1,47 @@
+/* Copyright (C) 2013-2018 Matthias Melcher.
+   This file is part of the Potrace integration of Iota. It is covered
+   by the GNU General Public License. See the file COPYING for details. */
+
+/* bump allocation of path and curve data, see potrace_trace_scratch() */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#include "potracelib.h"
+
+typedef struct arena_block_s arena_block_t;
+
+/* a list of memory blocks. Memory is handed out from the current block
+   in sequence and is only given back all at once. The blocks are kept
+   for the next use. */
+struct arena_s {
+  arena_block_t *first;  /* first block, or NULL */
+  arena_block_t *cur;    /* allocations are taken from this block */
+};
+typedef struct arena_s arena_t;
+
+/* the memory of a trace. Everything that is part of a path is allocated
+   from data and stays valid until the arena is used again. Temporary
+   arrays are allocated from scratch and are released after each path.
+   This is the private state of a potrace_state_t. */
+struct potrace_privstate_s {
+  arena_t data;
+  arena_t scratch;
+};
+
+/* all allocations in potrace go through these functions. While a trace
+   with an arena is running on this thread, memory comes from the arena
+   and arena_free() does nothing. Otherwise, they use the C library. */
+void *arena_calloc(size_t n, size_t size);
+void *arena_scratch_calloc(size_t n, size_t size);
+void *arena_realloc(void *p, size_t oldsize, size_t newsize);
+void arena_free(void *p);
+void arena_scratch_reset(void);
+
+/* make an arena current on this thread; returns the previous arena */
+potrace_arena_t *arena_enter(potrace_arena_t *a);
+void arena_leave(potrace_arena_t *prev);
+
+#endif /* ARENA_H */
@@ -15,9 +15,10 @@
 #include "potracelib.h"
 #include "lists.h"
 #include "curve.h"
+#include "arena.h"
 
 #define SAFE_CALLOC(var, n, typ) \
-  if ((var = (typ *)calloc(n, sizeof(typ))) == NULL) goto calloc_error 
+  if ((var = (typ *)arena_calloc(n, sizeof(typ))) == NULL) goto calloc_error 
 
 /* ---------------------------------------------------------------------- */
 /* allocate and free path objects */
@@ -34,36 +35,36 @@ path_t *path_new(void) {
   return p;
 
  calloc_error:
-  free(p);
-  free(priv);
+  arena_free(p);
+  arena_free(priv);
   return NULL;
 }
 
 /* free the members of the given curve structure. Leave errno unchanged. */
 static void privcurve_free_members(privcurve_t *curve) {
-  free(curve->tag);
-  free(curve->c);
-  free(curve->vertex);
-  free(curve->alpha);
-  free(curve->alpha0);
-  free(curve->beta);
+  arena_free(curve->tag);
+  arena_free(curve->c);
+  arena_free(curve->vertex);
+  arena_free(curve->alpha);
+  arena_free(curve->alpha0);
+  arena_free(curve->beta);
 }
 
 /* free a path. Leave errno untouched. */
 void path_free(path_t *p) {
   if (p) {
     if (p->priv) {
-      free(p->priv->pt);
-      free(p->priv->lon);
-      free(p->priv->sums);
-      free(p->priv->po);
+      arena_free(p->priv->pt);
+      arena_free(p->priv->lon);
+      arena_free(p->priv->sums);
+      arena_free(p->priv->po);
       privcurve_free_members(&p->priv->curve);
       privcurve_free_members(&p->priv->ocurve);
     }
-    free(p->priv);
+    arena_free(p->priv);
     /* do not free p->fcurve ! */
   }
-  free(p);
+  arena_free(p);
 }  
 
 /* free a pathlist, leaving errno untouched. */
@@ -94,12 +95,12 @@ int privcurve_init(privcurve_t *curve, int n) {
   return 0;
 
  calloc_error:
-  free(curve->tag);
-  free(curve->c);
-  free(curve->vertex);
-  free(curve->alpha);
-  free(curve->alpha0);
-  free(curve->beta);
+  arena_free(curve->tag);
+  arena_free(curve->c);
+  arena_free(curve->vertex);
+  arena_free(curve->alpha);
+  arena_free(curve->alpha0);
+  arena_free(curve->beta);
   return 1;
 }
 
@@ -20,6 +20,7 @@
 #include "bitmap.h"
 #include "decompose.h"
 #include "progress.h"
+#include "arena.h"
 
 /* ---------------------------------------------------------------------- */
 /* deterministically and efficiently hash (x,y) into a pseudo-random bit */
@@ -220,9 +221,10 @@ static path_t *findpath(potrace_bitmap_t *bm, int x0, int y0, int sign, int turn
   while (1) {
     /* add point to path */
     if (len>=size) {
+      int oldsize = size;
       size += 100;
       size = (int)(1.3 * size);
-      pt1 = (point_t *)realloc(pt, size * sizeof(point_t));
+      pt1 = (point_t *)arena_realloc(pt, oldsize * sizeof(point_t), size * sizeof(point_t));
       if (!pt1) {
 	goto error;
       }
@@ -286,7 +288,7 @@ static path_t *findpath(potrace_bitmap_t *bm, int x0, int y0, int sign, int turn
   return p;
  
  error:
-   free(pt);
+   arena_free(pt);
    return NULL; 
 }
 
@@ -459,17 +461,33 @@ static int findnext(potrace_bitmap_t *bm, int *xp, int *yp) {
    set. */
 
 int bm_to_pathlist(const potrace_bitmap_t *bm, path_t **plistp, const potrace_param_t *param, progress_t *progress) {
+  potrace_bitmap_t *bm1;
+  int r;
+
+  bm1 = bm_new(bm->w, bm->h);
+  if (!bm1) {
+    return -1;
+  }
+  r = bm_to_pathlist_scratch(bm, bm1, plistp, param, progress);
+  bm_free(bm1);
+  return r;
+}
+
+/* Like bm_to_pathlist, but use the caller's bitmap bm1 as working
+   memory instead of allocating a copy of bm. bm1 must have the same
+   size as bm. Its previous content is ignored and it is left in an
+   undefined state. */
+
+int bm_to_pathlist_scratch(const potrace_bitmap_t *bm, potrace_bitmap_t *bm1, path_t **plistp, const potrace_param_t *param, progress_t *progress) {
   int x;
   int y;
   path_t *p;
   path_t *plist = NULL;  /* linked list of path objects */
   path_t **plist_hook = &plist;  /* used to speed up appending to linked list */
-  potrace_bitmap_t *bm1 = NULL;
   int sign;
 
-  bm1 = bm_dup(bm);
-  if (!bm1) {
-    goto error;
+  for (y=0; y < bm->h; y++) {
+    memcpy(bm_scanline(bm1, y), bm_scanline(bm, y), (size_t)bm1->dy * (size_t)BM_WORDSIZE);
   }
 
   /* be sure the byte padding on the right is set to 0, as the fast
@@ -505,7 +523,6 @@ int bm_to_pathlist(const potrace_bitmap_t *bm, path_t **plistp, const potrace_pa
   }
 
   pathlist_to_tree(plist, bm1);
-  bm_free(bm1);
   *plistp = plist;
 
   progress_update(1.0, progress);
@@ -513,7 +530,6 @@ int bm_to_pathlist(const potrace_bitmap_t *bm, path_t **plistp, const potrace_pa
   return 0;
 
  error:
-  bm_free(bm1);
   list_forall_unlink(p, plist) {
     path_free(p);
   }
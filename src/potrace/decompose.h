@@ -11,6 +11,7 @@
 #include "curve.h"
 
 int bm_to_pathlist(const potrace_bitmap_t *bm, path_t **plistp, const potrace_param_t *param, progress_t *progress);
+int bm_to_pathlist_scratch(const potrace_bitmap_t *bm, potrace_bitmap_t *bm1, path_t **plistp, const potrace_param_t *param, progress_t *progress);
 
 #endif /* DECOMPOSE_H */
 
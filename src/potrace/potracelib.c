@@ -12,6 +12,7 @@
 #include "decompose.h"
 #include "trace.h"
 #include "progress.h"
+#include "arena.h"
 
 /* default parameters */
 static const potrace_param_t param_default = {
@@ -48,9 +49,22 @@ potrace_param_t *potrace_param_default(void) {
    set). Complete or incomplete Potrace state can be freed with
    potrace_state_free(). */
 potrace_state_t *potrace_trace(const potrace_param_t *param, const potrace_bitmap_t *bm) {
+  return potrace_trace_scratch(param, bm, NULL, NULL);
+}
+
+/* Like potrace_trace, but use the given bitmap as working memory
+   instead of allocating a copy of bm for every call. scratch must have
+   the same size as bm, and its content is destroyed. If scratch is
+   NULL, a copy is allocated.
+
+   If arena is not NULL, all paths and curves are allocated from it
+   instead of the C library. Using the arena again invalidates the
+   state of the previous trace, so that state must be freed first. */
+potrace_state_t *potrace_trace_scratch(const potrace_param_t *param, const potrace_bitmap_t *bm, potrace_bitmap_t *scratch, potrace_arena_t *arena) {
   int r;
   path_t *plist = NULL;
   potrace_state_t *st;
+  potrace_arena_t *prev;
   progress_t prog;
   progress_t subprog;
   
@@ -68,18 +82,25 @@ potrace_state_t *potrace_trace(const potrace_param_t *param, const potrace_bitma
     return NULL;
   }
 
+  prev = arena_enter(arena);
+
   progress_subrange_start(0.0, 0.1, &prog, &subprog);
 
   /* process the image */
-  r = bm_to_pathlist(bm, &plist, param, &subprog);
+  if (scratch) {
+    r = bm_to_pathlist_scratch(bm, scratch, &plist, param, &subprog);
+  } else {
+    r = bm_to_pathlist(bm, &plist, param, &subprog);
+  }
   if (r) {
+    arena_leave(prev);
     free(st);
     return NULL;
   }
 
   st->status = POTRACE_STATUS_OK;
   st->plist = plist;
-  st->priv = NULL;  /* private state currently unused */
+  st->priv = arena;  /* owns the paths, if not NULL */
 
   progress_subrange_end(&prog, &subprog);
 
@@ -93,12 +114,17 @@ potrace_state_t *potrace_trace(const potrace_param_t *param, const potrace_bitma
 
   progress_subrange_end(&prog, &subprog);
 
+  arena_leave(prev);
+
   return st;
 }
 
 /* free a Potrace state, without disturbing errno. */
 void potrace_state_free(potrace_state_t *st) {
-  pathlist_free(st->plist);
+  /* paths in an arena are given back when the arena is used again */
+  if (!st->priv) {
+    pathlist_free(st->plist);
+  }
   free(st);
 }
 
@@ -112,6 +112,9 @@ struct potrace_state_s {
 };
 typedef struct potrace_state_s potrace_state_t;
 
+/* memory that is reused from one trace to the next */
+typedef struct potrace_privstate_s potrace_arena_t;
+
 /* ---------------------------------------------------------------------- */
 /* API functions */
 
@@ -125,6 +128,17 @@ void potrace_param_free(potrace_param_t *p);
 potrace_state_t *potrace_trace(const potrace_param_t *param, 
 			       const potrace_bitmap_t *bm);
 
+/* trace a bitmap, using scratch as working memory of the same size, and
+   allocating all paths from arena */
+potrace_state_t *potrace_trace_scratch(const potrace_param_t *param,
+				       const potrace_bitmap_t *bm,
+				       potrace_bitmap_t *scratch,
+				       potrace_arena_t *arena);
+
+/* create and free memory for potrace_trace_scratch() */
+potrace_arena_t *potrace_arena_new(void);
+void potrace_arena_free(potrace_arena_t *arena);
+
 /* free a Potrace state */
 void potrace_state_free(potrace_state_t *st);
 
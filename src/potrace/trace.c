@@ -19,6 +19,7 @@
 #include "auxiliary.h"
 #include "trace.h"
 #include "progress.h"
+#include "arena.h"
 
 #define INFTY 10000000	/* it suffices that this is longer than any
 			   path; it need not be really infinite */
@@ -26,7 +27,11 @@
 
 /* ---------------------------------------------------------------------- */
 #define SAFE_CALLOC(var, n, typ) \
-  if ((var = (typ *)calloc(n, sizeof(typ))) == NULL) goto calloc_error 
+  if ((var = (typ *)arena_calloc(n, sizeof(typ))) == NULL) goto calloc_error 
+
+/* for arrays that are only needed until the current path is processed */
+#define SCRATCH_CALLOC(var, n, typ) \
+  if ((var = (typ *)arena_scratch_calloc(n, sizeof(typ))) == NULL) goto calloc_error 
 
 /* ---------------------------------------------------------------------- */
 /* auxiliary functions */
@@ -335,8 +340,8 @@ static int calc_lon(privpath_t *pp) {
   point_t dk;  /* direction of k-k1 */
   int a, b, c, d;
 
-  SAFE_CALLOC(pivk, n, int);
-  SAFE_CALLOC(nc, n, int);
+  SCRATCH_CALLOC(pivk, n, int);
+  SCRATCH_CALLOC(nc, n, int);
 
   /* initialize the nc data structure. Point from each point to the
      furthest future point to which it is connected by a vertical or
@@ -458,13 +463,13 @@ static int calc_lon(privpath_t *pp) {
     pp->lon[i] = j;
   }
 
-  free(pivk);
-  free(nc);
+  arena_free(pivk);
+  arena_free(nc);
   return 0;
 
  calloc_error:
-  free(pivk);
-  free(nc);
+  arena_free(pivk);
+  arena_free(nc);
   return 1;
 }
 
@@ -541,12 +546,12 @@ static int bestpolygon(privpath_t *pp)
   double best;
   int c;
 
-  SAFE_CALLOC(pen, n+1, double);
-  SAFE_CALLOC(prev, n+1, int);
-  SAFE_CALLOC(clip0, n, int);
-  SAFE_CALLOC(clip1, n+1, int);
-  SAFE_CALLOC(seg0, n+1, int);
-  SAFE_CALLOC(seg1, n+1, int);
+  SCRATCH_CALLOC(pen, n+1, double);
+  SCRATCH_CALLOC(prev, n+1, int);
+  SCRATCH_CALLOC(clip0, n, int);
+  SCRATCH_CALLOC(clip1, n+1, int);
+  SCRATCH_CALLOC(seg0, n+1, int);
+  SCRATCH_CALLOC(seg1, n+1, int);
 
   /* calculate clipped paths */
   for (i=0; i<n; i++) {
@@ -616,21 +621,21 @@ static int bestpolygon(privpath_t *pp)
     pp->po[j] = i;
   }
 
-  free(pen);
-  free(prev);
-  free(clip0);
-  free(clip1);
-  free(seg0);
-  free(seg1);
+  arena_free(pen);
+  arena_free(prev);
+  arena_free(clip0);
+  arena_free(clip1);
+  arena_free(seg0);
+  arena_free(seg1);
   return 0;
   
  calloc_error:
-  free(pen);
-  free(prev);
-  free(clip0);
-  free(clip1);
-  free(seg0);
-  free(seg1);
+  arena_free(pen);
+  arena_free(prev);
+  arena_free(clip0);
+  arena_free(clip1);
+  arena_free(seg0);
+  arena_free(seg1);
   return 1;
 }
 
@@ -659,9 +664,9 @@ static int adjust_vertices(privpath_t *pp) {
   dpoint_t s;
   int r;
 
-  SAFE_CALLOC(ctr, m, dpoint_t);
-  SAFE_CALLOC(dir, m, dpoint_t);
-  SAFE_CALLOC(q, m, quadform_t);
+  SCRATCH_CALLOC(ctr, m, dpoint_t);
+  SCRATCH_CALLOC(dir, m, dpoint_t);
+  SCRATCH_CALLOC(q, m, quadform_t);
 
   r = privcurve_init(&pp->curve, m);
   if (r) {
@@ -733,7 +738,7 @@ static int adjust_vertices(privpath_t *pp) {
 
 #ifdef HAVE_GCC_LOOP_BUG
       /* work around gcc bug #12243 */
-      free(NULL);
+      arena_free(NULL);
 #endif
       
       det = Q[0][0]*Q[1][1] - Q[0][1]*Q[1][0];
@@ -826,15 +831,15 @@ static int adjust_vertices(privpath_t *pp) {
     continue;
   }
 
-  free(ctr);
-  free(dir);
-  free(q);
+  arena_free(ctr);
+  arena_free(dir);
+  arena_free(q);
   return 0;
 
  calloc_error:
-  free(ctr);
-  free(dir);
-  free(q);
+  arena_free(ctr);
+  arena_free(dir);
+  arena_free(q);
   return 1;
 }
 
@@ -1079,12 +1084,12 @@ static int opticurve(privpath_t *pp, double opttolerance) {
   int *convc = NULL; /* conv[m]: pre-computed convexities */
   double *areac = NULL; /* cumarea[m+1]: cache for fast area computation */
 
-  SAFE_CALLOC(pt, m+1, int);
-  SAFE_CALLOC(pen, m+1, double);
-  SAFE_CALLOC(len, m+1, int);
-  SAFE_CALLOC(opt, m+1, opti_t);
-  SAFE_CALLOC(convc, m, int);
-  SAFE_CALLOC(areac, m+1, double);
+  SCRATCH_CALLOC(pt, m+1, int);
+  SCRATCH_CALLOC(pen, m+1, double);
+  SCRATCH_CALLOC(len, m+1, int);
+  SCRATCH_CALLOC(opt, m+1, opti_t);
+  SCRATCH_CALLOC(convc, m, int);
+  SCRATCH_CALLOC(areac, m+1, double);
 
   /* pre-calculate convexity: +1 = right turn, -1 = left turn, 0 = corner */
   for (i=0; i<m; i++) {
@@ -1140,8 +1145,8 @@ static int opticurve(privpath_t *pp, double opttolerance) {
   if (r) {
     goto calloc_error;
   }
-  SAFE_CALLOC(s, om, double);
-  SAFE_CALLOC(t, om, double);
+  SCRATCH_CALLOC(s, om, double);
+  SCRATCH_CALLOC(t, om, double);
 
   j = m;
   for (i=om-1; i>=0; i--) {
@@ -1176,25 +1181,25 @@ static int opticurve(privpath_t *pp, double opttolerance) {
   }
   pp->ocurve.alphacurve = 1;
 
-  free(pt);
-  free(pen);
-  free(len);
-  free(opt);
-  free(s);
-  free(t);
-  free(convc);
-  free(areac);
+  arena_free(pt);
+  arena_free(pen);
+  arena_free(len);
+  arena_free(opt);
+  arena_free(s);
+  arena_free(t);
+  arena_free(convc);
+  arena_free(areac);
   return 0;
 
  calloc_error:
-  free(pt);
-  free(pen);
-  free(len);
-  free(opt);
-  free(s);
-  free(t);
-  free(convc);
-  free(areac);
+  arena_free(pt);
+  arena_free(pen);
+  arena_free(len);
+  arena_free(opt);
+  arena_free(s);
+  arena_free(t);
+  arena_free(convc);
+  arena_free(areac);
   return 1;
 }
 
@@ -1233,6 +1238,7 @@ int process_path(path_t *plist, const potrace_param_t *param, progress_t *progre
       p->priv->fcurve = &p->priv->curve;
     }
     privcurve_to_curve(p->priv->fcurve, &p->curve);
+    arena_scratch_reset();
 
     if (progress->callback) {
       cn += p->priv->len;
@@ -12,6 +12,11 @@
 #include "view/IAProgressDialog.h"
 #include "toolpath/IAToolpath.h"
 #include "opengl/IAFramebuffer.h"
+#include "opengl/IABitmapPool.h"
+#include "opengl/IAVoxelVolume.h"
+#include "opengl/IABridgeFinder.h"
+#include "geometry/IAMeshBVH.h"
+#include "potrace/bitmap.h"
 
 
 #include <FL/Fl_Native_File_Chooser.H>
@@ -19,6 +24,12 @@
 #include <FL/Fl_Choice.H>
 #include <FL/filename.H>
 
+#include <algorithm>
+
+
+/** Preview layers are rendered with this many times fewer pixels in x and y. */
+static const int kPreviewScale = 4;
+
 
 /*
  How do we find a lid?
@@ -160,6 +171,7 @@ static const char *supportPresetDefaults[] = {
     "supportTopGap",    "1", "1", "1", "1",
     "supportSideGap",   "0.2", "0.2", "0.2", "0.2",
     "supportBottomGap", "1", "1", "1", "1",
+    "maxBridgeSpan",    "10", "10", "10", "10",
     "supportExtruder",  "0", "0", "0", "1",
     nullptr
 };
@@ -173,6 +185,7 @@ IAFDMPrinter::IAFDMPrinter()
     supportPreset.addClient(supportTopGap);
     supportPreset.addClient(supportSideGap);
     supportPreset.addClient(supportBottomGap);
+    supportPreset.addClient(maxBridgeSpan);
     supportPreset.addClient(supportExtruder);
     supportPreset.initialPresets( supportPresetDefaults );
 }
@@ -190,15 +203,27 @@ IAFDMPrinter::IAFDMPrinter(IAFDMPrinter const& src)
     numLids.set( src.numLids() );
     lidType.set( src.lidType() );
     infillDensity = src.infillDensity;
+    infillType.set( src.infillType() );
     hasSkirt.set( src.hasSkirt() );
+    skirtLoops.set( src.skirtLoops() );
+    skirtDistance.set( src.skirtDistance() );
     minimumLayerTime.set( src.minimumLayerTime() );
+    rasterStorage.set( src.rasterStorage() );
+    coreCompression.set( src.coreCompression() );
+    progressivePreview.set( src.progressivePreview() );
+    shellTracer.set( src.shellTracer() );
+    lidTracer.set( src.lidTracer() );
+    infillTracer.set( src.infillTracer() );
+    supportTracer.set( src.supportTracer() );
+    seamPlacement.set( src.seamPlacement() );
     /** \bug and all other properties and settings */
 }
 
 
 IAFDMPrinter::~IAFDMPrinter()
 {
-    // nothing to delete
+    Fl::remove_timeout(refinePreviewCB, this);
+    purgeSupportPasses();
 }
 
 
@@ -363,6 +388,17 @@ void IAFDMPrinter::initializeSceneSettings()
                                     [this]{purgeSlicesAndCaches();}, infillDensityMenuMenu );
     pSceneSettings.push_back(s);
 
+    static Fl_Menu_Item infillTypeMenu[] = {
+        { "stripes", 0, nullptr, (void*)0, 0, 0, 0, 11 },
+        { "zigzag", 0, nullptr, (void*)1, 0, 0, 0, 11 },
+        { nullptr } };
+
+    s = new IAChoiceController("infillType", "infill type: ", infillType,
+                               [this]{purgeSlicesAndCaches();}, infillTypeMenu );
+    s->tooltip("Trace the outline of every infill stripe, or link the infill lines "
+               "into long zigzag paths with fewer travel moves and retractions.");
+    pSceneSettings.push_back(s);
+
     static Fl_Menu_Item skirtMenu[] = {
         { "no", 0, nullptr, (void*)0, 0, 0, 0, 11 },
         { "yes", 0, nullptr, (void*)1, 0, 0, 0, 11 },
@@ -372,6 +408,28 @@ void IAFDMPrinter::initializeSceneSettings()
                                [this]{purgeSlicesAndCaches();}, skirtMenu );
     pSceneSettings.push_back(s);
 
+    static Fl_Menu_Item skirtLoopsMenu[] = {
+        { "1", 0, nullptr, (void*)1, 0, 0, 0, 11 },
+        { "2", 0, nullptr, (void*)2, 0, 0, 0, 11 },
+        { "3", 0, nullptr, (void*)3, 0, 0, 0, 11 },
+        { "5", 0, nullptr, (void*)5, 0, 0, 0, 11 },
+        { nullptr } };
+    s = new IAChoiceController("skirtLoops", "# of skirt loops: ", skirtLoops,
+                               [this]{purgeSlicesAndCaches();}, skirtLoopsMenu );
+    pSceneSettings.push_back(s);
+
+    static Fl_Menu_Item skirtDistanceMenu[] = {
+        { "0", 0, nullptr, (void*)0, 0, 0, 0, 11 },
+        { "1", 0, nullptr, (void*)0, 0, 0, 0, 11 },
+        { "3", 0, nullptr, (void*)0, 0, 0, 0, 11 },
+        { "5", 0, nullptr, (void*)0, 0, 0, 0, 11 },
+        { nullptr } };
+    s = new IAFloatChoiceController("skirtDistance", "skirt distance: ", skirtDistance, "mm",
+                                    [this]{purgeSlicesAndCaches();}, skirtDistanceMenu );
+    s->tooltip("Gap between the model and the skirt. A distance of 0 mm "
+               "creates a brim that sticks to the model for better adhesion.");
+    pSceneSettings.push_back(s);
+
     static Fl_Menu_Item layerTimeMenu[] = {
         { "0 sec.", 0, nullptr, (void*)0, 0, 0, 0, 11 },
         { "15 sec.", 0, nullptr, (void*)0, 0, 0, 0, 11 },
@@ -465,6 +523,30 @@ void IAFDMPrinter::initializeSceneSettings()
                                  [this]{purgeSlicesAndCaches();}, bottomGapMenu );
     pSceneSettings.push_back(s);
 
+    static Fl_Menu_Item bridgeSpanMenu[] = {
+        { "0mm",  0, nullptr, (void*)0, 0, 0, 0, 11 },
+        { "5mm",  0, nullptr, (void*)1, 0, 0, 0, 11 },
+        { "10mm", 0, nullptr, (void*)2, 0, 0, 0, 11 },
+        { "20mm", 0, nullptr, (void*)3, 0, 0, 0, 11 },
+        { nullptr } };
+    static Fl_Menu_Item supportTypeMenu[] = {
+        { "columns", 0, nullptr, (void*)0, 0, 0, 0, 11 },
+        { "tree",    0, nullptr, (void*)1, 0, 0, 0, 11 },
+        { nullptr } };
+    s = new IAChoiceController("support/type", "support type: ", supportType,
+                               [this]{purgeSlicesAndCaches();}, supportTypeMenu );
+    s->tooltip("Columns fill the entire area under an overhang. Trees grow thin "
+               "branches from the overhang down to the bed or the model, and "
+               "merge them on the way.");
+    pSceneSettings.push_back(s);
+
+    s = new IAFloatChoiceController("support/bridgeSpan", "max. bridge: ", maxBridgeSpan, "mm",
+                                 [this]{purgeSlicesAndCaches();}, bridgeSpanMenu );
+    s->tooltip("Overhangs that are held by the layer below on two opposite sides "
+               "within this distance are printed as a bridge instead of "
+               "getting support. Set this to 0 to support all overhangs.");
+    pSceneSettings.push_back(s);
+
     // We need an extruder ref controller that displays the current material and
     // color for the choosen extruder. For mixing extruders, this could even allow
     // a choice of color?
@@ -485,6 +567,68 @@ void IAFDMPrinter::initializeSceneSettings()
                                [this]{purgeSlicesAndCaches();}, toolChangeMenu );
     pSceneSettings.push_back(s);
 
+    pSceneSettings.push_back(new IALabelController("slicing", "Slicing"));
+
+    static Fl_Menu_Item rasterStorageMenu[] = {
+        { "flat bitmap",  0, nullptr, (void*)0, 0, 0, 0, 11 },
+        { "tiled bitmap", 0, nullptr, (void*)1, 0, 0, 0, 11 },
+        { nullptr } };
+    s = new IAChoiceController("slicing/raster", "raster storage: ", rasterStorage,
+                               [this]{purgeSlicesAndCaches();}, rasterStorageMenu );
+    s->tooltip("Tiled bitmaps store large empty or filled areas of a layer without "
+               "using pixel memory. This is faster for thin walled models.");
+    pSceneSettings.push_back(s);
+
+    static Fl_Menu_Item coreCompressionMenu[] = {
+        { "none",  0, nullptr, (void*)0, 0, 0, 0, 11 },
+        { "spans", 0, nullptr, (void*)1, 0, 0, 0, 11 },
+        { nullptr } };
+    s = new IAChoiceController("slicing/coreCache", "layer cache: ", coreCompression,
+                               [this]{purgeSlicesAndCaches();}, coreCompressionMenu );
+    s->tooltip("Every layer is kept in memory while neighboring layers are sliced. "
+               "Compressing layers uses a lot less memory for tall prints.");
+    pSceneSettings.push_back(s);
+
+    static Fl_Menu_Item previewMenu[] = {
+        { "on release",  0, nullptr, (void*)0, 0, 0, 0, 11 },
+        { "progressive", 0, nullptr, (void*)1, 0, 0, 0, 11 },
+        { nullptr } };
+    s = new IAChoiceController("slicing/preview", "preview: ", progressivePreview,
+                               [this]{purgeSlicesAndCaches();}, previewMenu );
+    s->tooltip("Slice the visible layers when the layer slider is released, or show "
+               "a coarse outline right away and refine it while the app is idle.");
+    pSceneSettings.push_back(s);
+
+    static Fl_Menu_Item tracerMenu[] = {
+        { "curves",   0, nullptr, (void*)0, 0, 0, 0, 11 },
+        { "straight", 0, nullptr, (void*)1, 0, 0, 0, 11 },
+        { nullptr } };
+    s = new IAChoiceController("slicing/shellTracer", "shell outline: ", shellTracer,
+                               [this]{purgeSlicesAndCaches();}, tracerMenu );
+    s->tooltip("Fit curves to the outline with potrace, or trace it quickly with "
+               "straight segments within the trace tolerance.");
+    pSceneSettings.push_back(s);
+    s = new IAChoiceController("slicing/lidTracer", "lid outline: ", lidTracer,
+                               [this]{purgeSlicesAndCaches();}, tracerMenu );
+    pSceneSettings.push_back(s);
+    s = new IAChoiceController("slicing/infillTracer", "infill outline: ", infillTracer,
+                               [this]{purgeSlicesAndCaches();}, tracerMenu );
+    pSceneSettings.push_back(s);
+    s = new IAChoiceController("slicing/supportTracer", "support outline: ", supportTracer,
+                               [this]{purgeSlicesAndCaches();}, tracerMenu );
+    pSceneSettings.push_back(s);
+
+    static Fl_Menu_Item seamMenu[] = {
+        { "nearest", 0, nullptr, (void*)0, 0, 0, 0, 11 },
+        { "aligned", 0, nullptr, (void*)1, 0, 0, 0, 11 },
+        { "corner",  0, nullptr, (void*)2, 0, 0, 0, 11 },
+        { nullptr } };
+    s = new IAChoiceController("slicing/seam", "seam: ", seamPlacement,
+                               []{}, seamMenu );
+    s->tooltip("Start every loop close to where the previous toolpath ended, at the "
+               "rear of the loop so that seams line up, or in the sharpest corner.");
+    pSceneSettings.push_back(s);
+
     // Extrusion width
     // Extrusion speed
 
@@ -540,75 +684,121 @@ void IAFDMPrinter::userSliceGenerateAll()
 
 
 /**
- * Create and add the toolpath for a skirt around the omesh base.
+ * Find the convex hull of the mesh, projected onto the build platform.
+ *
+ * \param mesh use the global position of all vertices of this mesh
+ * \param hull receives the corners of the hull in counter clockwise order,
+ *      as x and y pairs; a single corner if all vertices are in one point
+ */
+static void convexFootprint(IAMesh *mesh, std::vector<IAVector3d> &hull)
+{
+    std::vector<IAVector3d> pt;
+    pt.reserve(mesh->vertexList.size());
+    for (auto &v: mesh->vertexList)
+        pt.push_back( { v->pGlobalPosition.x(), v->pGlobalPosition.y(), 0.0 } );
+    std::sort(pt.begin(), pt.end(), [](const IAVector3d &a, const IAVector3d &b) {
+        return a.x()<b.x() || (a.x()==b.x() && a.y()<b.y());
+    });
+    pt.erase(std::unique(pt.begin(), pt.end(), [](const IAVector3d &a, const IAVector3d &b) {
+        return a.x()==b.x() && a.y()==b.y();
+    }), pt.end());
+    hull.clear();
+    if (pt.empty()) return;
+
+    // Andrew's monotone chain: build the lower, then the upper hull
+    auto cross = [](const IAVector3d &o, const IAVector3d &a, const IAVector3d &b) {
+        return (a.x()-o.x())*(b.y()-o.y()) - (a.y()-o.y())*(b.x()-o.x());
+    };
+    std::vector<IAVector3d> h(2*pt.size());
+    size_t k = 0;
+    for (size_t i=0; i<pt.size(); i++) {
+        while (k>=2 && cross(h[k-2], h[k-1], pt[i])<=0.0) k--;
+        h[k++] = pt[i];
+    }
+    for (size_t i=pt.size()-1, t=k+1; i>0; i--) {
+        while (k>=t && cross(h[k-2], h[k-1], pt[i-1])<=0.0) k--;
+        h[k++] = pt[i-1];
+    }
+    // the last point is the same as the first one
+    if (k>1) k--;
+    h.resize(k);
+    hull.swap(h);
+}
+
+
+/**
+ * Create and add the toolpath for a skirt around the mesh base.
+ *
+ * The skirt follows the convex hull of the entire mesh as seen from above.
+ * Every loop is the hull, grown by a fixed distance, with round corners, so
+ * it can be calculated directly without rendering the mesh. A skirt
+ * distance of 0 creates a brim that touches the model.
  */
 void IAFDMPrinter::addToolpathForSkirt(IAToolpathList *tp, int i)
 {
+    if (!Iota.pMesh) return;
     double z = sliceIndexToZ(i);
-    IAFramebuffer skirt(this, IAFramebuffer::RGBA);
-    skirt.bindForRendering();
-    glPushMatrix();
-    glTranslated(Iota.pMesh->position().x(), Iota.pMesh->position().y(), Iota.pMesh->position().z());
-    Iota.pMesh->draw(IAMesh::kMASK, 1.0, 1.0, 1.0);
-    glPopMatrix();
-    skirt.unbindFromRendering();
-    skirt.toolpathFromLassoAndExpand(z, 3);  // 3mm, should probably be more if the extrusion is 1mm or more
-    IAToolpathListSP tpSkirt1 = skirt.toolpathFromLassoAndContract(z, nozzleDiameter());
-    tp->add(tpSkirt1.get(), modelExtruder(), 5, 0);
-    IAToolpathListSP tpSkirt2 = skirt.toolpathFromLassoAndContract(z, nozzleDiameter());
-    tp->add(tpSkirt2.get(), modelExtruder(), 5, 1);
+    Iota.pMesh->updateGlobalSpace();
+    std::vector<IAVector3d> hull;
+    convexFootprint(Iota.pMesh, hull);
+    int n = (int)hull.size();
+    if (n==0) return;
+
+    // outward normal angle of every edge, from corner j to corner j+1
+    std::vector<double> edgeAngle(n);
+    for (int j=0; j<n; j++) {
+        const IAVector3d &a = hull[j], &b = hull[(j+1)%n];
+        edgeAngle[j] = atan2(-(b.x()-a.x()), b.y()-a.y());
+    }
+
+    double w = nozzleDiameter();
+    for (int k=0; k<skirtLoops(); k++) {
+        double r = skirtDistance() + w*(k+0.5);
+        IAToolpathLoop *loop = new IAToolpathLoop(z);
+        bool first = true;
+        for (int j=0; j<n; j++) {
+            // a round corner from the normal of the previous edge to the
+            // normal of the next edge; a single point becomes a circle
+            double a0 = (n==1) ? 0.0 : edgeAngle[(j+n-1)%n];
+            double da = (n==1) ? 2.0*M_PI : edgeAngle[j]-a0;
+            while (da<0.0) da += 2.0*M_PI;
+            int nSeg = std::max( (n==1) ? 8 : 1, (int)ceil(da*r/w) );
+            int nPt = (n==1) ? nSeg : nSeg+1;
+            for (int s=0; s<nPt; s++) {
+                double a = a0 + da*s/nSeg;
+                double x = hull[j].x() + r*cos(a), y = hull[j].y() + r*sin(a);
+                if (first) {
+                    loop->startPath(x, y);
+                    first = false;
+                } else {
+                    loop->continuePath(x, y);
+                }
+            }
+        }
+        loop->closePath();
+        tp->add(loop, modelExtruder(), 5, k);
+    }
 }
 
 
 /**
  * Create and add the toolpath for a support structure under overhangs.
+ *
+ * The area that needs support is calculated for all layers at once by
+ * acquireSupportPatterns().
  */
 void IAFDMPrinter::addToolpathForSupport(IAToolpathList *tp, int i)
 {
     double z = sliceIndexToZ(i);
-    IAFramebuffer support(this, IAFramebuffer::RGBAZ);
-
-    support.bindForRendering();
-
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_GREATER);
-
-    glClearDepth(0.0);
-    glClear(GL_DEPTH_BUFFER_BIT);
-
-    // Draw only what is above the current z plane, but leave a little
-    // space between the model and the support to reduce stickyness
-    support.beginClipBelowZ(z + supportTopGap()*layerHeight());
-
-    /** \bug don't do this for every layer! */
-    // mark all triangles that need support first, then render only those
-    // mark all vertices that need support, then render them here
-    Iota.pMesh->drawAngledFaces(90.0+supportAngle());
-
-    glPushMatrix();
-    // Draw the upper part of the model, so that the support will not
-    // protrude through it. Leave a little gap so that the support
-    // Also, remember if we need support at all.
-    // sticks less to the model.
-    glTranslated(Iota.pMesh->position().x(),
-                 Iota.pMesh->position().y(),
-                 Iota.pMesh->position().z()
-                 + (supportBottomGap()+supportTopGap())*layerHeight());
-    Iota.pMesh->draw(IAMesh::kMASK, 0.0, 0.0, 0.0);
-    glPopMatrix();
-
-    support.endClip();
-
-    glDepthFunc(GL_LESS);
-    glClearDepth(1.0);
-
-    support.unbindFromRendering();
-    /** \bug change to bitmap mode */
+    acquireSupportPatterns();
+    if (!pSliceList[i].pSupportBitmap) return;
+    IAFramebuffer support(pSliceList[i].pSupportBitmap);
 
     // reduce the size of the mask to leave room for the filament, plus
     // a little gap so that the support tower sides do not stick to
     // the model.
-    support.toolpathFromLassoAndContract(z, nozzleDiameter()/2.0 + supportSideGap());
+    auto tracer = (IAFramebuffer::Tracer)supportTracer();
+    support.toolpathFromLassoAndContract(z, nozzleDiameter()/2.0 + supportSideGap(), tracer);
 
     // Fill it.
     if (i==0) {
@@ -618,11 +808,602 @@ void IAFDMPrinter::addToolpathForSupport(IAToolpathList *tp, int i)
         // other layers use the set density
         support.overlayInfillPattern(0, 2*nozzleDiameter() * (100.0 / supportDensity()) - nozzleDiameter());
     }
-    auto supportPath = support.toolpathFromLasso(z);
+    auto supportPath = support.toolpathFromLasso(z, tracer);
     if (supportPath) tp->add(supportPath.get(), supportExtruder(), 60, 0);
     /// \todo don't draw anything here which we will draw otherwise later
     /** \bug find icicles and draw support for those */
-    /** \bug find and exclude bridges */
+}
+
+
+/**
+ * A branch of a support tree while it grows down.
+ */
+struct IATreeNode {
+    double x, y, r;
+    /** Index of this branch in the layer above in the list of placed branches, or -1 */
+    int above;
+};
+
+
+/**
+ * A branch of a support tree in one layer.
+ *
+ * Branches can only be printed if they end on the bed or on the model.
+ * That is not known until the pass reaches the bottom, so all branches
+ * are collected first.
+ */
+struct IATreePlacement {
+    double x, y, r;
+    int layer;
+    /** Index of the same branch one layer down, or -1 if the branch ends here */
+    int below;
+    /** Where the branch ends: 0 in mid air, 1 on the model, 2 on the bed */
+    int ground;
+    /** Number of layers between the branch and the model that it ends on */
+    int height;
+};
+
+
+/**
+ * The state of acquireTreeSupport() between two steps.
+ */
+struct IATreeSupportPass {
+    IATreeSupportPass(int nContacts, int n, IAMesh *mesh)
+    :   contact(nContacts, 0), bvh(mesh), next(n-1) { }
+    /** Set for every grid point that already started a branch */
+    std::vector<char> contact;
+    /** Finds the surface of the model below a branch */
+    IAMeshBVH bvh;
+    /** The branches that reached the layer above next */
+    std::vector<IATreeNode> nodes;
+    std::vector<IATreePlacement> placed;
+    /** The layer that is handled next, going down */
+    int next;
+};
+
+
+/**
+ * Test single pixels of a bitmap buffer in world coordinates.
+ *
+ * readRow() decodes an entire row of a compressed or tiled buffer. Tree
+ * support tests the same few rows many times per layer, so every row is
+ * decoded only the first time it is needed.
+ */
+struct IABitmapProbe {
+    /**
+     * Start probing another buffer, keeping the memory of the last one.
+     *
+     * \param buffer a BITMAP or TILED buffer, compressed or not, or nullptr
+     */
+    void use(IAFramebuffer *buffer, const IAVector3d &volume) {
+        fb = buffer;
+        vol = volume;
+        if (!fb) return;
+        wordsPerRow = (fb->width()+BM_WORDBITS-1)/BM_WORDBITS;
+        decoded.assign(fb->height(), 0);
+        rows.resize((size_t)wordsPerRow*fb->height());
+    }
+    /** Return true if the pixel at x, y in mm is set */
+    bool isSetAt(double x, double y) {
+        if (!fb) return false;
+        int px = (int)(x/vol.x()*fb->width()), py = (int)(y/vol.y()*fb->height());
+        if (px<0 || py<0 || px>=fb->width() || py>=fb->height()) return false;
+        potrace_word *row = rows.data() + (size_t)py*wordsPerRow;
+        if (!decoded[py]) {
+            fb->readRow(py, row);
+            decoded[py] = 1;
+        }
+        return (row[px/BM_WORDBITS] & bm_mask(px)) != 0;
+    }
+    IAFramebuffer *fb = nullptr;
+    IAVector3d vol;
+    int wordsPerRow = 0;
+    std::vector<char> decoded;
+    std::vector<potrace_word> rows;
+};
+
+
+/**
+ * Branches of one layer, sorted into a grid of square cells.
+ *
+ * Branches only interact with branches nearby, so neighbor searches visit
+ * a few cells instead of all branches of the layer. Positions outside of
+ * the print volume are kept in the cells along its border.
+ */
+struct IATreeGrid {
+    IATreeGrid(double cellSize, const IAVector3d &vol)
+    :   size(cellSize),
+        nx((int)(vol.x()/cellSize)+1), ny((int)(vol.y()/cellSize)+1),
+        cell((size_t)nx*ny) { }
+    int cellX(double x) const { return std::min(std::max((int)floor(x/size), 0), nx-1); }
+    int cellY(double y) const { return std::min(std::max((int)floor(y/size), 0), ny-1); }
+    std::vector<int> &at(double x, double y) { return cell[(size_t)cellY(y)*nx+cellX(x)]; }
+    void clear() { for (auto &c: cell) c.clear(); }
+    void add(int index, double x, double y) { at(x, y).push_back(index); }
+    void remove(int index, double x, double y) {
+        auto &c = at(x, y);
+        c.erase(std::find(c.begin(), c.end(), index));
+    }
+    /** Call f(index) for every branch in a cell up to r away from x, y */
+    template<typename F> void visit(double x, double y, double r, F f) const {
+        for (int cy=cellY(y-r); cy<=cellY(y+r); cy++)
+            for (int cx=cellX(x-r); cx<=cellX(x+r); cx++)
+                for (int index: cell[(size_t)cy*nx+cx])
+                    f(index);
+    }
+    /** Call f(index) for every branch in the ring of cells ring steps around x, y */
+    template<typename F> void visitRing(double x, double y, int ring, F f) const {
+        int x0 = cellX(x), y0 = cellY(y);
+        for (int cy=std::max(y0-ring, 0); cy<=std::min(y0+ring, ny-1); cy++) {
+            bool edge = (cy==y0-ring || cy==y0+ring);
+            for (int cx=std::max(x0-ring, 0); cx<=std::min(x0+ring, nx-1); cx++) {
+                if (!edge && cx!=x0-ring && cx!=x0+ring) continue;
+                for (int index: cell[(size_t)cy*nx+cx])
+                    f(index);
+            }
+        }
+    }
+    double size;
+    int nx, ny;
+    std::vector<std::vector<int>> cell;
+};
+
+
+/**
+ * Grow support trees from all overhangs down to the bed or the model.
+ *
+ * Contact points are placed on a grid in the support area of
+ * acquireSupportPatterns(). Every point starts a branch in the highest
+ * layer where it needs support. Going down layer by layer, branches lean
+ * toward their nearest neighbor no steeper than the overhang angle, and
+ * merge into a thicker branch when they meet. Branches move around the
+ * model and end when they reach the bed or land on the model. A branch
+ * lands where a ray straight down finds an upward facing triangle within
+ * one layer, using a bounding volume hierarchy over the mesh.
+ *
+ * A branch that finds no way around the model becomes thinner, or joins a
+ * neighbor. If that fails too, the branch and everything that merged into
+ * it from above is dropped, so that nothing is printed in mid air. Branches
+ * that land on the model stop supportBottomGap() layers above it.
+ *
+ * Every branch is written as concentric loops into pSupportToolpath of
+ * each layer it passes through.
+ *
+ * \param oneStep if set, handle only one layer and return; the next call
+ *      continues where this one stopped
+ * \return true if the trees are complete
+ */
+bool IAFDMPrinter::acquireTreeSupport(bool oneStep)
+{
+    if (pTreeSupportValid || !Iota.pMesh) return true;
+    if (!acquireSupportPatterns(oneStep)) return false;
+
+    int n = numSlices();
+    IAVector3d vol = pPrintVolume;
+    double spacing = 2*nozzleDiameter() * (100.0 / supportDensity());
+    double tipRadius = nozzleDiameter();
+    double maxRadius = 4.0*nozzleDiameter();
+    double maxMove = layerHeight()*tan(supportAngle()/180.0*M_PI);
+    double clearance = supportSideGap() + nozzleDiameter()/2.0;
+    int bottomGap = (int)lround(supportBottomGap());
+    int nx = (int)(vol.x()/spacing), ny = (int)(vol.y()/spacing);
+    if (!pTreeSupportPass) {
+        Iota.pMesh->updateGlobalSpace();
+        pTreeSupportPass = new IATreeSupportPass(nx*ny, n, Iota.pMesh);
+    }
+    auto &contact = pTreeSupportPass->contact;
+    auto &nodes = pTreeSupportPass->nodes;
+    auto &placed = pTreeSupportPass->placed;
+    IABitmapProbe obstacle, area;
+    IATreeGrid grid(spacing, vol), nextGrid(spacing, vol);
+
+    while (pTreeSupportPass->next>=0) {
+        int j = pTreeSupportPass->next--;
+        obstacle.use(pSliceList[j].pSliceBitmap, vol);
+        auto isFree = [&](double x, double y, double r) {
+            if (obstacle.isSetAt(x, y)) return false;
+            for (int k=0; k<8; k++) {
+                double a = k*M_PI/4.0, d = r+clearance;
+                if (obstacle.isSetAt(x+d*cos(a), y+d*sin(a))) return false;
+            }
+            return true;
+        };
+        // find a free spot near a branch, up to three steps away
+        auto findFree = [&](IATreeNode &nd, double r) {
+            for (int ring=1; ring<=3; ring++) {
+                for (int k=0; k<8; k++) {
+                    double a = k*M_PI/4.0;
+                    double x = nd.x + ring*maxMove*cos(a), y = nd.y + ring*maxMove*sin(a);
+                    if (isFree(x, y, r)) {
+                        nd.x = x; nd.y = y; nd.r = r;
+                        return true;
+                    }
+                }
+            }
+            return false;
+        };
+
+        // lean every branch toward its nearest neighbor
+        grid.clear();
+        for (size_t a=0; a<nodes.size(); a++)
+            grid.add((int)a, nodes[a].x, nodes[a].y);
+        std::vector<IATreeNode> moved(nodes);
+        for (size_t a=0; a<nodes.size(); a++) {
+            IATreeNode &nd = moved[a];
+            double best = DBL_MAX;
+            int nearestIndex = -1;
+            // branches in this ring and further out are at least reach away
+            for (int ring=0; ring<=std::max(grid.nx, grid.ny); ring++) {
+                double reach = (ring-1)*spacing;
+                if (ring>1 && best<reach*reach)
+                    break;
+                grid.visitRing(nd.x, nd.y, ring, [&](int b) {
+                    if (b==(int)a) return;
+                    double dx = nodes[b].x-nd.x, dy = nodes[b].y-nd.y;
+                    double d = dx*dx+dy*dy;
+                    if (d<best || (d==best && b<nearestIndex)) { best = d; nearestIndex = b; }
+                });
+            }
+            if (nearestIndex>=0) {
+                const IATreeNode *nearest = &nodes[nearestIndex];
+                // both branches move, so meet halfway
+                double d = sqrt(best);
+                double step = d/2.0<maxMove ? d/2.0 : maxMove;
+                if (d>0.0) {
+                    nd.x += (nearest->x-nd.x)/d*step;
+                    nd.y += (nearest->y-nd.y)/d*step;
+                }
+            }
+        }
+
+        // look for an upward facing surface within the next layer below
+        // every branch; all branches of a layer are sent as one batch
+        std::vector<IAMeshBVH::Ray> rays(moved.size());
+        std::vector<IAMeshBVH::Hit> hits;
+        for (size_t a=0; a<moved.size(); a++) {
+            rays[a].pOrigin = IAVector3d(moved[a].x, moved[a].y, sliceIndexToZ(j+1));
+            rays[a].pDirection = IAVector3d(0.0, 0.0, -1.0);
+            rays[a].pMaxT = layerHeight();
+        }
+        pTreeSupportPass->bvh.closestHit(rays, hits);
+
+        // move existing branches down by one layer
+        std::vector<IATreeNode> next;
+        nextGrid.clear();
+        // branches that merged into a branch in next: index in placed, index in next
+        std::vector<std::pair<int, int>> joined;
+        for (size_t a=0; a<moved.size(); a++) {
+            IATreeNode nd = moved[a];
+            // the branch landed on the model
+            IATriangle *surface = hits[a].pTriangle;
+            if (surface && surface->pNormal.z()>0.0) {
+                placed[nd.above].ground = 1;
+                placed[nd.above].height = 1;
+                continue;
+            }
+            // move around the model, getting thinner if needed
+            bool free = isFree(nd.x, nd.y, nd.r) || findFree(nd, nd.r);
+            if (!free && nd.r>tipRadius) {
+                if (isFree(nd.x, nd.y, tipRadius)) {
+                    nd.r = tipRadius;
+                    free = true;
+                } else {
+                    free = findFree(nd, tipRadius);
+                }
+            }
+            if (!free) {
+                // join the nearest branch that already moved, if it is close
+                int target = -1;
+                double targetDist = 3.0*maxMove;
+                nextGrid.visit(nd.x, nd.y, targetDist+maxRadius, [&](int m) {
+                    double d = hypot(next[m].x-nd.x, next[m].y-nd.y) - next[m].r;
+                    if (d<targetDist || (d==targetDist && m<target)) { targetDist = d; target = m; }
+                });
+                // otherwise the branch and all branches above it are dropped
+                if (target>=0)
+                    joined.push_back( { nd.above, target } );
+                continue;
+            }
+            // merge with the first branch that we already moved, if they touch
+            int target = -1;
+            nextGrid.visit(nd.x, nd.y, maxRadius, [&](int m) {
+                const IATreeNode &mn = next[m];
+                double dx = mn.x-nd.x, dy = mn.y-nd.y;
+                if ((target<0 || m<target) && sqrt(dx*dx+dy*dy) < (mn.r>nd.r ? mn.r : nd.r))
+                    target = m;
+            });
+            if (target>=0) {
+                IATreeNode &mn = next[target];
+                nextGrid.remove(target, mn.x, mn.y);
+                double wa = mn.r*mn.r, wb = nd.r*nd.r;
+                mn.x = (mn.x*wa + nd.x*wb)/(wa+wb);
+                mn.y = (mn.y*wa + nd.y*wb)/(wa+wb);
+                mn.r = sqrt(wa+wb);
+                if (mn.r>maxRadius) mn.r = maxRadius;
+                nextGrid.add(target, mn.x, mn.y);
+                joined.push_back( { nd.above, target } );
+            } else {
+                nextGrid.add((int)next.size(), nd.x, nd.y);
+                next.push_back(nd);
+            }
+        }
+        nodes.swap(next);
+
+        // start new branches where the support area begins
+        if (pSliceList[j].pSupportBitmap) {
+            area.use(pSliceList[j].pSupportBitmap, vol);
+            for (int gy=0; gy<ny; gy++) {
+                for (int gx=0; gx<nx; gx++) {
+                    char &c = contact[(size_t)gy*nx+gx];
+                    if (c) continue;
+                    double x = (gx+0.5)*spacing, y = (gy+0.5)*spacing;
+                    if (area.isSetAt(x, y)) {
+                        c = 1;
+                        nodes.push_back( { x, y, tipRadius, -1 } );
+                    }
+                }
+            }
+        }
+
+        // place all branches in this layer and link them to the layer above
+        int base = (int)placed.size();
+        for (auto &nd: nodes) {
+            if (nd.above>=0)
+                placed[nd.above].below = (int)placed.size();
+            nd.above = (int)placed.size();
+            placed.push_back( { nd.x, nd.y, nd.r, j, -1, (j==0) ? 2 : 0, 0 } );
+        }
+        for (auto &jn: joined)
+            placed[jn.first].below = base+jn.second;
+        if (oneStep) break;
+    }
+    if (pTreeSupportPass->next>=0)
+        return false;
+
+    // branches are placed top down, so the layer below is always further back
+    for (int k=(int)placed.size()-1; k>=0; k--) {
+        IATreePlacement &p = placed[k];
+        if (p.below>=0) {
+            p.ground = placed[p.below].ground;
+            p.height = placed[p.below].height+1;
+        }
+    }
+
+    // write every branch that stands on something as concentric loops
+    for (auto &p: placed) {
+        if (p.ground==0 || (p.ground==1 && p.height<=bottomGap))
+            continue;
+        IAFDMSlice &s = pSliceList[p.layer];
+        double z = sliceIndexToZ(p.layer);
+        if (!s.pSupportToolpath)
+            s.pSupportToolpath = new IAToolpathList(z);
+        for (double r=p.r; r>nozzleDiameter()/4.0; r-=nozzleDiameter()) {
+            int nSeg = (int)(2.0*M_PI*r/nozzleDiameter());
+            if (nSeg<8) nSeg = 8;
+            IAToolpathLoop *loop = new IAToolpathLoop(z);
+            loop->startPath(p.x+r, p.y);
+            for (int k=1; k<nSeg; k++) {
+                double a = 2.0*M_PI*k/nSeg;
+                loop->continuePath(p.x+r*cos(a), p.y+r*sin(a));
+            }
+            loop->closePath();
+            s.pSupportToolpath->add(loop, supportExtruder(), 60, 0);
+        }
+    }
+
+    delete pTreeSupportPass;
+    pTreeSupportPass = nullptr;
+    pTreeSupportValid = true;
+    return true;
+}
+
+
+/**
+ * Find the overhangs in a layer that can be printed as a bridge.
+ *
+ * The result is stored compressed in IAFDMSlice::pBridgeBitmap, or stays
+ * nullptr if there are no bridges in this layer.
+ */
+void IAFDMPrinter::acquireBridgePattern(int i)
+{
+    IAFDMSlice &s = pSliceList[i];
+    if (s.pBridgeValid) return;
+    s.pBridgeValid = true;
+    if (i==0 || maxBridgeSpan()<=0.0) return;
+
+    acquireCorePattern(i);
+    acquireCorePattern(i-1);
+    IAFramebuffer *bridge = new IAFramebuffer(this, IAFramebuffer::BITMAP);
+    int maxSpan = (int)(maxBridgeSpan()/pPrintVolume.x()*bridge->width());
+    IABridgeFinder finder(bridge->width(), bridge->height(), maxSpan);
+    bridge->bindForRendering();
+    int angle = finder.find(s.pSliceBitmap, pSliceList[i-1].pSliceBitmap, bridge->pBitmap);
+    bridge->unbindFromRendering();
+    if (angle<0) {
+        delete bridge;
+        return;
+    }
+    bridge->compress();
+    s.pBridgeBitmap = bridge;
+    s.pBridgeAngle = angle;
+}
+
+
+/**
+ * Fill the bridged area of a layer with lines that run from anchor to anchor.
+ */
+void IAFDMPrinter::addToolpathForBridge(IAToolpathList *tp, int i, IAFramebuffer &bridge)
+{
+    double z = sliceIndexToZ(i);
+    bridge.overlayLidPattern(pSliceList[i].pBridgeAngle==90 ? 1 : 0, nozzleDiameter());
+    auto bridgePath = bridge.toolpathFromLasso(z, (IAFramebuffer::Tracer)lidTracer());
+    if (bridgePath) tp->add(bridgePath.get(), modelExtruder(), 20, 0);
+}
+
+
+/**
+ * Clip a polygon at a plane parallel to the build platform.
+ *
+ * \param in, n the polygon
+ * \param z the clipping plane
+ * \param keepAbove if set, keep the part above z, else keep the part below
+ * \param out receives up to n+1 vertices
+ * \return the number of vertices in out
+ */
+static int clipPolygonAtZ(const IAVector3d *in, int n, double z, bool keepAbove, IAVector3d *out)
+{
+    double sign = keepAbove ? 1.0 : -1.0;
+    int m = 0;
+    for (int i=0; i<n; i++) {
+        const IAVector3d &a = in[i], &b = in[(i+1)%n];
+        double da = sign*(a.z()-z), db = sign*(b.z()-z);
+        if (da>=0.0) out[m++] = a;
+        if ( (da>=0.0) != (db>=0.0) )
+            out[m++] = a + (b-a)*(da/(da-db));
+    }
+    return m;
+}
+
+
+/**
+ * The state of acquireSupportPatterns() between two steps.
+ */
+struct IASupportPatternPass {
+    IASupportPatternPass(IAPrinter *printer, int n)
+    :   overhangs(n), shadow(printer, IAFramebuffer::BITMAP), next(n-1) { }
+    /** Overhanging triangles, sorted into the layers that they cross */
+    std::vector<std::vector<IATriangle*> > overhangs;
+    /** Everything below an overhang without any model in between */
+    IAFramebuffer shadow;
+    /** The layer that is handled next, going down */
+    int next;
+};
+
+
+/**
+ * Calculate the area that needs support for every layer.
+ *
+ * Overhanging triangles are found once and sorted into the layers they
+ * cross. A shadow bitmap is then carried from the top layer down to the
+ * build platform. In every layer, the parts of the overhangs within that
+ * layer are added to the shadow, and the slice of the model is removed from
+ * it, so the shadow holds everything that is below an overhang without any
+ * model in between. The support for a layer is the shadow supportTopGap()
+ * layers above it, minus the model slices within the top and bottom gap.
+ *
+ * Overhangs that can be printed as a bridge are removed from the shadow.
+ *
+ * The result is stored compressed in IAFDMSlice::pSupportBitmap. The cost
+ * grows with the number of layers plus the number of triangles, instead of
+ * with their product.
+ *
+ * \param oneStep if set, handle only one layer and return, so that the
+ *      caller can keep the user interface running; the next call continues
+ *      where this one stopped
+ * \return true if the support area of all layers is known
+ */
+bool IAFDMPrinter::acquireSupportPatterns(bool oneStep)
+{
+    if (pSupportPatternsValid || !Iota.pMesh) return true;
+
+    int n = numSlices();
+    double lh = layerHeight();
+    int topGap = (int)lround(supportTopGap());
+    int bottomGap = (int)lround(supportBottomGap());
+
+    if (!pSupportPatternPass) {
+        pSupportPatternPass = new IASupportPatternPass(this, n);
+        // find all triangles that need support and sort them into layer buckets
+        IAVector3d zVec = { 0.0, 0.0, 1.0 };
+        double ref = cos((90.0+supportAngle())/180.0*M_PI);
+        auto &overhangs = pSupportPatternPass->overhangs;
+        for (auto &t: Iota.pMesh->triangleList) {
+            if (t->pNormal.dot(zVec)>=ref) continue;
+            double zMin = t->vertex(0)->pGlobalPosition.z(), zMax = zMin;
+            for (int j=1; j<3; j++) {
+                double vz = t->vertex(j)->pGlobalPosition.z();
+                if (vz<zMin) zMin = vz;
+                if (vz>zMax) zMax = vz;
+            }
+            int lo = (int)floor((zMin-sliceIndexToZ(0))/lh);
+            int hi = (int)floor((zMax-sliceIndexToZ(0))/lh);
+            if (lo<0) lo = 0;
+            if (hi>n-1) hi = n-1;
+            for (int j=lo; j<=hi; j++)
+                overhangs[j].push_back(t);
+        }
+    }
+
+    auto &overhangs = pSupportPatternPass->overhangs;
+    IAFramebuffer &shadow = pSupportPatternPass->shadow;
+    IAVector3d tri[3], tmp[4], poly[5];
+    while (pSupportPatternPass->next>=0) {
+        int j = pSupportPatternPass->next--;
+        acquireCorePattern(j);
+
+        // add the overhangs between this layer and the next one
+        double zLo = sliceIndexToZ(j), zHi = sliceIndexToZ(j+1);
+        shadow.bindForRendering();
+        for (auto &t: overhangs[j]) {
+            for (int k=0; k<3; k++)
+                tri[k] = t->vertex(k)->pGlobalPosition;
+            int nt = clipPolygonAtZ(tri, 3, zLo, true, tmp);
+            int np = clipPolygonAtZ(tmp, nt, zHi, false, poly);
+            if (np<3) continue;
+            shadow.beginComplexPolygon();
+            for (int k=0; k<np; k++)
+                shadow.addPoint(poly[k]);
+            shadow.endComplexPolygon(1);
+        }
+        shadow.unbindFromRendering();
+
+        // overhangs that the next layer can bridge need no support
+        if (j+1<n) {
+            acquireBridgePattern(j+1);
+            if (pSliceList[j+1].pBridgeBitmap)
+                shadow.logicAndNot(pSliceList[j+1].pBridgeBitmap);
+        }
+
+        // the model stops the shadow
+        shadow.logicAndNot(pSliceList[j].pSliceBitmap);
+
+        // the shadow is now complete for the layer that is topGap below
+        int i = j-topGap;
+        if (i>=0) {
+            IAFramebuffer *support = new IAFramebuffer(&shadow);
+            for (int k=i-bottomGap; k<j; k++) {
+                if (k>=0) {
+                    acquireCorePattern(k);
+                    support->logicAndNot(pSliceList[k].pSliceBitmap);
+                }
+            }
+            support->compress();
+            delete pSliceList[i].pSupportBitmap;
+            pSliceList[i].pSupportBitmap = support;
+        }
+        if (oneStep) break;
+    }
+    if (pSupportPatternPass->next>=0)
+        return false;
+
+    delete pSupportPatternPass;
+    pSupportPatternPass = nullptr;
+    pSupportPatternsValid = true;
+    return true;
+}
+
+
+/**
+ * Forget all support areas and trees, including passes that are not done.
+ */
+void IAFDMPrinter::purgeSupportPasses()
+{
+    delete pSupportPatternPass;
+    pSupportPatternPass = nullptr;
+    pSupportPatternsValid = false;
+    delete pTreeSupportPass;
+    pTreeSupportPass = nullptr;
+    pTreeSupportValid = false;
 }
 
 
@@ -636,16 +1417,17 @@ void IAFDMPrinter::createToolpathForShell(int i, IAFramebuffer *fb)
 {
     double z = sliceIndexToZ(i);
 
+    auto tracer = (IAFramebuffer::Tracer)shellTracer();
     IAToolpathListSP tp0 = nullptr, tp1 = nullptr, tp2 = nullptr, tp3 = nullptr;
     if (numShells()>0) {
-        tp0 = fb->toolpathFromLassoAndContract(z, 0.5 * nozzleDiameter());
-        tp1 = tp0 ? fb->toolpathFromLassoAndContract(z, nozzleDiameter()) : nullptr;
+        tp0 = fb->toolpathFromLassoAndContract(z, 0.5 * nozzleDiameter(), tracer);
+        tp1 = tp0 ? fb->toolpathFromLassoAndContract(z, nozzleDiameter(), tracer) : nullptr;
     }
     if (numShells()>1) {
-        tp2 = tp1 ? fb->toolpathFromLassoAndContract(z, nozzleDiameter()) : nullptr;
+        tp2 = tp1 ? fb->toolpathFromLassoAndContract(z, nozzleDiameter(), tracer) : nullptr;
     }
     if (numShells()>2) {
-        tp3 = tp2 ? fb->toolpathFromLassoAndContract(z, nozzleDiameter()) : nullptr;
+        tp3 = tp2 ? fb->toolpathFromLassoAndContract(z, nozzleDiameter(), tracer) : nullptr;
     }
     /** \todo We can create an overlap between the infill and the shell by
      *      reducing the second parameter of toolpathFromLassoAndContract
@@ -658,6 +1440,8 @@ void IAFDMPrinter::createToolpathForShell(int i, IAFramebuffer *fb)
     if (tp1) tp->add(tp1.get(), modelExtruder(), 40, 2);
     if (pSliceList[i].pShellToolpath) delete pSliceList[i].pShellToolpath;
     pSliceList[i].pShellToolpath = tp;
+    // the core is only read from now on, when creating lids and infill
+    if (coreCompression()) fb->compress();
     pSliceList[i].pCoreBitmap = fb;
 }
 
@@ -665,17 +1449,18 @@ void IAFDMPrinter::createToolpathForShell(int i, IAFramebuffer *fb)
 void IAFDMPrinter::addToolpathForLid(IAToolpathList *tp, int i, IAFramebuffer &lid)
 {
     double z = sliceIndexToZ(i);
+    auto tracer = (IAFramebuffer::Tracer)lidTracer();
     if (lidType()==0) {
         // ZIGZAG (could do bridging if used in the correct direction!)
         lid.overlayInfillPattern(i, nozzleDiameter());
-        auto lidPath = lid.toolpathFromLasso(z);
+        auto lidPath = lid.toolpathFromLasso(z, tracer);
         if (lidPath) tp->add(lidPath.get(), modelExtruder(), 20, 0);
     } else {
         // CONCENTRIC (nicer for lids)
         /** \bug limit this to the width and hight of the build platform divided by the extrusion width */
         int k;
         for (k=0;k<300;k++) { /** \bug why 300? */
-            auto tp1 = lid.toolpathFromLassoAndContract(z, nozzleDiameter());
+            auto tp1 = lid.toolpathFromLassoAndContract(z, nozzleDiameter(), tracer);
             if (!tp1) break;
             tp->add(tp1.get(), modelExtruder(), 20, k);
         }
@@ -691,8 +1476,14 @@ void IAFDMPrinter::addToolpathForInfill(IAToolpathList *tp, int i, IAFramebuffer
     double z = sliceIndexToZ(i);
     /** \todo We are actually filling the areas twice, where the lids and the infill touch! */
     /** \todo remove material that we generated in the lid already */
-    infill.overlayInfillPattern(i, 2*nozzleDiameter() * (100.0 / infillDensity()) - nozzleDiameter());
-    auto infillPath = infill.toolpathFromLasso(z);
+    double infillWdt = 2*nozzleDiameter() * (100.0 / infillDensity()) - nozzleDiameter();
+    IAToolpathListSP infillPath;
+    if (infillType()==1) {
+        infillPath = infill.toolpathFromZigzag(z, i, infillWdt);
+    } else {
+        infill.overlayInfillPattern(i, infillWdt);
+        infillPath = infill.toolpathFromLasso(z, (IAFramebuffer::Tracer)infillTracer());
+    }
     if (infillPath) tp->add(infillPath.get(), modelExtruder(), 30, 0); /** \bug should be ExtruderDontCare */
 }
 
@@ -703,21 +1494,58 @@ double IAFDMPrinter::sliceIndexToZ(int i)
 }
 
 
+/**
+ * Curves may deviate by a tenth of the extrusion width.
+ *
+ * The nozzle can not reproduce finer detail, so there is no point in
+ * creating more segments for it.
+ */
+double IAFDMPrinter::curveTolerance()
+{
+    return std::max(super::curveTolerance(), 0.1 * nozzleDiameter());
+}
+
+
+/**
+ * Return the number of layers needed to slice the current mesh.
+ */
+int IAFDMPrinter::numSlices()
+{
+    double hgt = Iota.pMesh->pMax.z() - Iota.pMesh->pMin.z() + 2.0*layerHeight();
+    double zMin = layerHeight() * 0.9; // initial height
+    return (int)((hgt-zMin)/layerHeight()) + 2;
+}
+
+
 void IAFDMPrinter::acquireCorePattern(int i)
 {
     if (!pSliceList[i].pCoreBitmap) {
-        IAFramebuffer *sliceMap = new IAFramebuffer(this, IAFramebuffer::BITMAP);
+        IAFramebuffer::Buffers storage = rasterStorage() ? IAFramebuffer::TILED : IAFramebuffer::BITMAP;
+        IAFramebuffer *sliceMap = new IAFramebuffer(this, storage);
         IAMeshSlice *slc = new IAMeshSlice( this );
         slc->setNewZ(sliceIndexToZ(i));
         slc->generateRim(Iota.pMesh);
         slc->tesselateAndDrawLid(sliceMap);
+        if (hasSupport() || maxBridgeSpan()>0.0) {
+            // keep the entire slice for finding bridges and support
+            IAFramebuffer *slice = new IAFramebuffer(sliceMap);
+            slice->compress();
+            pSliceList[i].pSliceBitmap = slice;
+        }
         createToolpathForShell(i, sliceMap);
         delete slc;
     }
 }
 
 
-void IAFDMPrinter::sliceLayer(int i)
+/**
+ * Create all toolpaths for a single layer.
+ *
+ * \param i layer index
+ * \param solidMask pixels that are set in all numLids() layers above and below
+ *      this layer, or nullptr to calculate this from the neighboring cores
+ */
+void IAFDMPrinter::sliceLayer(int i, IAFramebuffer *solidMask)
 {
     if (!Iota.pMesh) return;
 
@@ -733,42 +1561,52 @@ void IAFDMPrinter::sliceLayer(int i)
     }
 
     // support structures
-    if (hasSupport() && !s.pSupportToolpath) {
+    if (hasSupport() && supportType()==1) {
+        acquireTreeSupport();
+    } else if (hasSupport() && !s.pSupportToolpath) {
         IAToolpathList *tp = pSliceList[i].pSupportToolpath = new IAToolpathList(z);
         addToolpathForSupport(tp, i);
     }
 
+    // bridges over gaps in the layer below
+    acquireBridgePattern(i);
+    if (s.pBridgeBitmap && !s.pBridgeToolpath) {
+        IAToolpathList *tp = pSliceList[i].pBridgeToolpath = new IAToolpathList(z);
+        IAFramebuffer bridge(pSliceList[i].pCoreBitmap);
+        bridge.logicAnd(s.pBridgeBitmap);
+        addToolpathForBridge(tp, i, bridge);
+    }
+
     if ((!s.pInfillToolpath) || (!s.pLidToolpath)) {
         IAFramebuffer infill(pSliceList[i].pCoreBitmap);
+        if (s.pBridgeBitmap)
+            infill.logicAndNot(s.pBridgeBitmap);
 
         // build lids and bottoms
         if (numLids()>0) {
-            acquireCorePattern(i+1);
-            IAFramebuffer mask(pSliceList[i+1].pCoreBitmap);
-            if (numLids()>1) {
-                acquireCorePattern(i+2);
-                if (pSliceList[i+2].pCoreBitmap)
-                    mask.logicAnd(pSliceList[i+2].pCoreBitmap);
-                else
-                    mask.fill(0);
-            }
-            if (i>0) {
-                acquireCorePattern(i-1);
-                mask.logicAnd(pSliceList[i-1].pCoreBitmap);
-            } else {
-                mask.fill(0);
-            }
-            if (numLids()>1) {
-                if (i>1) {
-                    acquireCorePattern(i-2);
-                    mask.logicAnd(pSliceList[i-2].pCoreBitmap);
-                } else {
-                    mask.fill(0);
+            if (!solidMask)
+                acquireCorePattern(i+1);
+            IAFramebuffer mask(solidMask ? solidMask : pSliceList[i+1].pCoreBitmap);
+            if (!solidMask) {
+                // AND the cores of all layers within numLids() above and below
+                for (int k=1; k<=numLids(); k++) {
+                    if (k>1) {
+                        acquireCorePattern(i+k);
+                        mask.logicAnd(pSliceList[i+k].pCoreBitmap);
+                    }
+                    if (i-k>=0) {
+                        acquireCorePattern(i-k);
+                        mask.logicAnd(pSliceList[i-k].pCoreBitmap);
+                    } else {
+                        mask.fill(0);
+                    }
                 }
             }
 
             IAFramebuffer lid(pSliceList[i].pCoreBitmap);
             lid.logicAndNot(&mask); /// \todo shrink lid
+            if (s.pBridgeBitmap)
+                lid.logicAndNot(s.pBridgeBitmap);
             infill.logicAnd(&mask); /// \todo shrink infill
             if (!s.pLidToolpath) {
                 IAToolpathList *tp = pSliceList[i].pLidToolpath = new IAToolpathList(z);
@@ -782,6 +1620,106 @@ void IAFDMPrinter::sliceLayer(int i)
             addToolpathForInfill(tp, i, infill);
         }
     }
+
+    s.pSliced = true;
+    delete s.pPreviewToolpath;
+    s.pPreviewToolpath = nullptr;
+}
+
+
+/**
+ * Create a coarse outline of a layer for a quick preview.
+ *
+ * The layer is rendered at a fraction of the raster resolution and only
+ * the outermost shell is traced, which is many times faster than slicing
+ * the layer. sliceLayer() replaces the preview later.
+ *
+ * \param i layer index
+ */
+void IAFDMPrinter::slicePreviewLayer(int i)
+{
+    if (!Iota.pMesh) return;
+    IAFDMSlice &s = pSliceList[i];
+    if (s.pSliced || s.pPreviewToolpath) return;
+
+    double z = sliceIndexToZ(i);
+    IAFramebuffer fb(this, IAFramebuffer::BITMAP);
+    fb.setSize(rasterWidth()/kPreviewScale, rasterHeight()/kPreviewScale);
+    IAMeshSlice *slc = new IAMeshSlice( this );
+    slc->setNewZ(z);
+    slc->generateRim(Iota.pMesh);
+    slc->tesselateAndDrawLid(&fb);
+    delete slc;
+
+    IAToolpathList *tp = new IAToolpathList(z);
+    auto tracer = (IAFramebuffer::Tracer)shellTracer();
+    auto outline = fb.toolpathFromLassoAndContract(z, 0.5 * nozzleDiameter(), tracer);
+    auto shell = outline ? fb.toolpathFromLasso(z, tracer) : nullptr;
+    if (shell) tp->add(shell.get(), modelExtruder(), 40, 0);
+    s.pPreviewToolpath = tp;
+}
+
+
+/**
+ * Show the top visible layer right away and refine all visible layers later.
+ */
+void IAFDMPrinter::startProgressivePreview()
+{
+    slicePreviewLayer(zRangeSlider->highValue()); /** \bug very direct access through a view */
+    gSceneView->redraw();
+    // wait until the user pauses before doing the expensive work
+    Fl::remove_timeout(refinePreviewCB, this);
+    Fl::add_timeout(0.1, refinePreviewCB, this);
+}
+
+
+/**
+ * Do one step of refining the visible layers, then call again later.
+ *
+ * All visible layers get a coarse preview first, then they are sliced at
+ * full quality, starting at the top. Only one layer is handled per call,
+ * so that the user interface stays responsive between calls. This includes
+ * the support passes, which run over every layer of the model before the
+ * first layer with support can be sliced.
+ */
+void IAFDMPrinter::refinePreview()
+{
+    if (!Iota.pMesh) return;
+    int n = numSlices();
+    int lo = std::max(0, (int)zRangeSlider->lowValue());
+    int hi = std::min(n-1, (int)zRangeSlider->highValue());
+
+    for (int i=hi; i>=lo; i--) {
+        IAFDMSlice &s = pSliceList[i];
+        if (!s.pSliced && !s.pPreviewToolpath) {
+            slicePreviewLayer(i);
+            gSceneView->redraw();
+            Fl::repeat_timeout(0.0, refinePreviewCB, this);
+            return;
+        }
+    }
+    // support needs a pass over all layers first, which is also done in steps
+    if (hasSupport()) {
+        bool done = (supportType()==1) ? acquireTreeSupport(true) : acquireSupportPatterns(true);
+        if (!done) {
+            Fl::repeat_timeout(0.0, refinePreviewCB, this);
+            return;
+        }
+    }
+    for (int i=hi; i>=lo; i--) {
+        if (!pSliceList[i].pSliced) {
+            sliceLayer(i);
+            gSceneView->redraw();
+            Fl::repeat_timeout(0.0, refinePreviewCB, this);
+            return;
+        }
+    }
+}
+
+
+void IAFDMPrinter::refinePreviewCB(void *printer)
+{
+    ((IAFDMPrinter*)printer)->refinePreview();
 }
 
 
@@ -791,21 +1729,37 @@ void IAFDMPrinter::sliceLayer(int i)
 void IAFDMPrinter::sliceAll()
 {
 //    pSliceMap.clear();
-    double hgt = Iota.pMesh->pMax.z() - Iota.pMesh->pMin.z() + 2.0*layerHeight();
-    double zMin = layerHeight() * 0.9; // initial height
-    double zLayerHeight = layerHeight();
-    double zMax = hgt;
-
+    Fl::remove_timeout(refinePreviewCB, this);
     IAProgressDialog::show("Generating slices",
                            "Slicing layer %d of %d at %.2fmm (%d%%)");
 
-    int i = 0, n = (int)((zMax-zMin)/zLayerHeight) + 2;
-
-    for (i=0; i<n; ++i)
-    {
-        double z = sliceIndexToZ(i);
-        if (IAProgressDialog::update(i*100/n, i, n, z, i*100/n)) break;
-        sliceLayer(i);
+    int i = 0, n = numSlices();
+
+    if (numLids()>0) {
+        // Stream all cores through a voxel volume once. The solid mask of
+        // layer i is ready after layer i+numLids() was added.
+        int nLids = numLids();
+        IAFramebuffer mask(this, IAFramebuffer::BITMAP);
+        IAVoxelVolume volume(mask.width(), mask.height(), nLids);
+        for (int j=0; j<n+nLids; ++j) {
+            acquireCorePattern(j);
+            volume.addLayer(pSliceList[j].pCoreBitmap);
+            i = j-nLids;
+            if (i<0) continue;
+            double z = sliceIndexToZ(i);
+            if (IAProgressDialog::update(i*100/n, i, n, z, i*100/n)) break;
+            mask.bindForRendering();
+            volume.solidMask(mask.pBitmap);
+            mask.unbindFromRendering();
+            sliceLayer(i, &mask);
+        }
+    } else {
+        for (i=0; i<n; ++i)
+        {
+            double z = sliceIndexToZ(i);
+            if (IAProgressDialog::update(i*100/n, i, n, z, i*100/n)) break;
+            sliceLayer(i);
+        }
     }
 
     IAProgressDialog::hide();
@@ -840,6 +1794,7 @@ void IAFDMPrinter::saveToolpath(const char *filename)
         if (s.pInfillToolpath) tp->add(s.pInfillToolpath);
         if (s.pSkirtToolpath) tp->add(s.pSkirtToolpath);
         if (s.pSupportToolpath) tp->add(s.pSupportToolpath);
+        if (s.pBridgeToolpath) tp->add(s.pBridgeToolpath);
     }
     machineToolpath.optimize();
     machineToolpath.saveGCode(filename);
@@ -848,7 +1803,9 @@ void IAFDMPrinter::saveToolpath(const char *filename)
 
 void IAFDMPrinter::rangeSliderChanged()
 {
-    if (Fl::event()==FL_RELEASE || Fl::event()==FL_KEYDOWN) {
+    if (progressivePreview()) {
+        startProgressivePreview();
+    } else if (Fl::event()==FL_RELEASE || Fl::event()==FL_KEYDOWN) {
         sliceLayer(zRangeSlider->highValue()); /** \bug very direct access through a view */
         gSceneView->redraw();
     }
@@ -861,9 +1818,15 @@ void IAFDMPrinter::rangeSliderChanged()
 void IAFDMPrinter::purgeSlicesAndCaches()
 {
     pSliceList.purge();
+    purgeSupportPasses();
+    IABitmapPool::purge();
     super::purgeSlicesAndCaches();
-    sliceLayer(zRangeSlider->highValue()); /** \bug very direct access through a view */
-    gSceneView->redraw();
+    if (progressivePreview()) {
+        startProgressivePreview();
+    } else {
+        sliceLayer(zRangeSlider->highValue()); /** \bug very direct access through a view */
+        gSceneView->redraw();
+    }
 }
 
 
@@ -875,11 +1838,13 @@ void IAFDMPrinter::drawPreview(double lo, double hi)
     /** \bug trigger building the slices in another thread */
     for (int i=lo; i<=hi; i++) {
         IAFDMSlice &s = pSliceList[i];
+        if (!s.pShellToolpath && s.pPreviewToolpath) s.pPreviewToolpath->draw();
         if (s.pShellToolpath) s.pShellToolpath->draw();
         if (s.pLidToolpath) s.pLidToolpath->draw();
         if (s.pInfillToolpath) s.pInfillToolpath->draw();
         if (s.pSkirtToolpath) s.pSkirtToolpath->draw();
         if (s.pSupportToolpath) s.pSupportToolpath->draw();
+        if (s.pBridgeToolpath) s.pBridgeToolpath->draw();
     }
 }
 
@@ -929,7 +1894,14 @@ void IAFDMSlice::purge()
     delete pInfillToolpath; pInfillToolpath = nullptr;
     delete pSkirtToolpath; pSkirtToolpath = nullptr;
     delete pSupportToolpath; pSupportToolpath = nullptr;
+    delete pBridgeToolpath; pBridgeToolpath = nullptr;
     delete pCoreBitmap; pCoreBitmap = nullptr;
+    delete pSliceBitmap; pSliceBitmap = nullptr;
+    delete pSupportBitmap; pSupportBitmap = nullptr;
+    delete pBridgeBitmap; pBridgeBitmap = nullptr;
+    pBridgeValid = false;
+    delete pPreviewToolpath; pPreviewToolpath = nullptr;
+    pSliced = false;
 }
 
 
@@ -15,6 +15,8 @@
 
 class IAFDMPrinter;
 class IAFDMSlice;
+struct IASupportPatternPass;
+struct IATreeSupportPass;
 
 
 class IAFDMSliceList
@@ -53,8 +55,23 @@ public:
     IAToolpathList *pInfillToolpath = nullptr;
     IAToolpathList *pSkirtToolpath = nullptr;
     IAToolpathList *pSupportToolpath = nullptr;
-    /// Store the bitmap for the slice without the shell
+    IAToolpathList *pBridgeToolpath = nullptr;
+    /// Store the bitmap for the slice without the shell, possibly compressed
     IAFramebuffer *pCoreBitmap = nullptr;
+    /// The entire slice including the shell, compressed; only kept for support
+    IAFramebuffer *pSliceBitmap = nullptr;
+    /// Area that needs support in this layer, compressed
+    IAFramebuffer *pSupportBitmap = nullptr;
+    /// Overhangs that can be bridged without support, compressed
+    IAFramebuffer *pBridgeBitmap = nullptr;
+    /// Direction of all bridges in this layer, 0 or 90 degrees
+    int pBridgeAngle = 0;
+    /// Set when we searched this layer for bridges
+    bool pBridgeValid = false;
+    /// Outline at a coarse resolution, shown until the layer is sliced
+    IAToolpathList *pPreviewToolpath = nullptr;
+    /// Set when all toolpaths of this layer were created
+    bool pSliced = false;
 };
 
 
@@ -109,8 +126,11 @@ public:
     IAIntProperty numLids { "numLids", 2 };
     IAIntProperty lidType { "lidType", 0 }; // 0=zigzag, 1=concentric
     IAFloatProperty infillDensity { "infillDensity", 20.0 }; // %
+    IAIntProperty infillType { "infillType", 1 }; // 0=outlined stripes, 1=linked zigzag
     // skirt, brim, raft, ooze shield/side wall (vertical, waterfall, contoured, #shells, max. angle); bottom layer speed factor, temperature, prime pillar
     IAIntProperty hasSkirt { "hasSkirt",  1 }; // prime line around perimeter
+    IAIntProperty skirtLoops { "skirtLoops", 2 };
+    IAFloatProperty skirtDistance { "skirtDistance", 3.0 }; // mm, 0 for a brim
     IAFloatProperty minimumLayerTime { "minimumLayerTime", 15.0 };
     IAExtruderProperty modelExtruder { "modelExtruder", 0 };
     // support
@@ -121,21 +141,44 @@ public:
     IAFloatProperty supportTopGap { "supportTopGap", 1.0 };
     IAFloatProperty supportSideGap { "supportSideGap", 0.2 };
     IAFloatProperty supportBottomGap { "supportBottomGap", 1.0 };
+    IAFloatProperty maxBridgeSpan { "maxBridgeSpan", 10.0 }; // mm, 0 to support all overhangs
+    IAIntProperty supportType { "supportType", 0 }; // 0=columns, 1=tree
     IAExtruderProperty supportExtruder { "supportExtruder", 0 };
     // material
     IAIntProperty toolChangeStrategy { "toolChangeStrategy", 1 };
+    // slicing
+    IAIntProperty rasterStorage { "rasterStorage", 0 }; // 0=flat bitmap, 1=tiled bitmap
+    IAIntProperty coreCompression { "coreCompression", 0 }; // 0=none, 1=span encoded rows
+    IAIntProperty progressivePreview { "progressivePreview", 1 }; // 0=slice on release, 1=coarse first
+    IAIntProperty shellTracer { "shellTracer", 0 }; // see IAFramebuffer::Tracer
+    IAIntProperty lidTracer { "lidTracer", 1 };
+    IAIntProperty infillTracer { "infillTracer", 1 };
+    IAIntProperty supportTracer { "supportTracer", 1 };
+    IAIntProperty seamPlacement { "seamPlacement", 0 }; // see IAToolpathLoop::Seam
     // models and meshes
     
     // ----
     double sliceIndexToZ(int i);
+    virtual double curveTolerance() override;
+    int numSlices();
 
     void acquireCorePattern(int i);
+    bool acquireSupportPatterns(bool oneStep=false);
+    void acquireBridgePattern(int i);
+    bool acquireTreeSupport(bool oneStep=false);
+    void purgeSupportPasses();
 
-    void sliceLayer(int i);
+    void sliceLayer(int i, IAFramebuffer *solidMask=nullptr);
+    void slicePreviewLayer(int i);
     void sliceAll();
 
+    void startProgressivePreview();
+    void refinePreview();
+    static void refinePreviewCB(void *printer);
+
     void addToolpathForSkirt(IAToolpathList *tp, int i);
     void addToolpathForSupport(IAToolpathList *tp, int i);
+    void addToolpathForBridge(IAToolpathList *tp, int i, IAFramebuffer &fb);
     void createToolpathForShell(int i, IAFramebuffer *slice);
     void addToolpathForLid(IAToolpathList *tp, int i, IAFramebuffer &fb);
     void addToolpathForInfill(IAToolpathList *tp, int i, IAFramebuffer &fb);
@@ -147,6 +190,18 @@ public:
 private:
 
     IAFDMSliceList pSliceList;
+
+    /// Set when the support pattern of every layer was calculated
+    bool pSupportPatternsValid = false;
+
+    /// State of acquireSupportPatterns() while it runs in steps
+    IASupportPatternPass *pSupportPatternPass = nullptr;
+
+    /// Set when the tree support toolpaths of every layer were created
+    bool pTreeSupportValid = false;
+
+    /// State of acquireTreeSupport() while it runs in steps
+    IATreeSupportPass *pTreeSupportPass = nullptr;
 };
 
 
@@ -17,6 +17,7 @@
 #include "toolpath/IAToolpath.h"
 
 #include <math.h>
+#include <thread>
 
 #include <FL/gl.h>
 #include <FL/glu.h>
@@ -58,6 +59,9 @@ IAPrinter::IAPrinter(IAPrinter const& src)
     printVolumeMin.set( src.printVolumeMin() );
     printVolumeMax.set( src.printVolumeMax() );
     layerHeight.set( src.layerHeight() );
+    rasterPitch.set( src.rasterPitch() );
+    traceThreads.set( src.traceThreads() );
+    traceTolerance.set( src.traceTolerance() );
 }
 
 
@@ -117,6 +121,46 @@ void IAPrinter::initializeSceneSettings()
                               [this]{userChangedLayerHeight();},
                               layerHeightMenu);
     pSceneSettings.push_back(s);
+
+    static Fl_Menu_Item rasterPitchMenu[] = {
+        { "0.025", 0, nullptr, nullptr, 0, 0, 0, 11 },
+        { "0.05", 0, nullptr, nullptr, 0, 0, 0, 11 },
+        { "0.1", 0, nullptr, nullptr, 0, 0, 0, 11 },
+        { }
+    };
+    s = new IAFloatChoiceController("slicing/rasterPitch", "pixel size:", rasterPitch, "mm",
+                              [this]{purgeSlicesAndCaches();},
+                              rasterPitchMenu);
+    s->tooltip("Layers are rendered into images with pixels of this size. An eighth "
+               "of the nozzle diameter gives smooth toolpaths. Smaller pixels use "
+               "more memory and time.");
+    pSceneSettings.push_back(s);
+
+    static Fl_Menu_Item traceThreadsMenu[] = {
+        { "all cores", 0, nullptr, (void*)0, 0, 0, 0, 11 },
+        { "single", 0, nullptr, (void*)1, 0, 0, 0, 11 },
+        { "2", 0, nullptr, (void*)2, 0, 0, 0, 11 },
+        { "4", 0, nullptr, (void*)4, 0, 0, 0, 11 },
+        { }
+    };
+    s = new IAChoiceController("slicing/traceThreads", "tracing threads:", traceThreads,
+                               [this]{purgeSlicesAndCaches();},
+                               traceThreadsMenu);
+    s->tooltip("Separate areas of a layer are traced in parallel.");
+    pSceneSettings.push_back(s);
+
+    static Fl_Menu_Item traceToleranceMenu[] = {
+        { "0.02", 0, nullptr, nullptr, 0, 0, 0, 11 },
+        { "0.05", 0, nullptr, nullptr, 0, 0, 0, 11 },
+        { "0.1", 0, nullptr, nullptr, 0, 0, 0, 11 },
+        { }
+    };
+    s = new IAFloatChoiceController("slicing/traceTolerance", "trace tolerance:", traceTolerance, "mm",
+                              [this]{purgeSlicesAndCaches();},
+                              traceToleranceMenu);
+    s->tooltip("Outlines that are traced with straight segments may be this far "
+               "away from the pixels of a layer.");
+    pSceneSettings.push_back(s);
 }
 
 
@@ -425,6 +469,63 @@ void IAPrinter::userChangedLayerHeight()
 }
 
 
+/**
+ * Number of pixels needed to cover a length at the current raster pitch.
+ */
+int IAPrinter::rasterSize(double length)
+{
+    double pitch = rasterPitch();
+    if (pitch<=0.0) pitch = 0.05;
+    int n = (int)ceil(length/pitch);
+    if (n<256) n = 256;
+    if (n>kMaxFramebufferSize) n = kMaxFramebufferSize;
+    return n;
+}
+
+
+/**
+ * Width of a framebuffer that covers the print volume, in pixels.
+ */
+int IAPrinter::rasterWidth()
+{
+    return rasterSize(pPrintVolume.x());
+}
+
+
+/**
+ * Height of a framebuffer that covers the print volume, in pixels.
+ */
+int IAPrinter::rasterHeight()
+{
+    return rasterSize(pPrintVolume.y());
+}
+
+
+/**
+ * Maximum distance between a traced curve and the segments that replace it.
+ *
+ * The raster holds no detail finer than half a pixel.
+ *
+ * \return the tolerance in mm
+ */
+double IAPrinter::curveTolerance()
+{
+    return 0.5 * pPrintVolume.x() / rasterWidth();
+}
+
+
+/**
+ * Number of threads that trace separate parts of a layer at the same time.
+ */
+int IAPrinter::numTraceThreads()
+{
+    int n = traceThreads();
+    if (n<=0) n = (int)std::thread::hardware_concurrency();
+    if (n<=0) n = 1;
+    return n;
+}
+
+
 void IAPrinter::updateBuildVolume()
 {
     printVolumeMin().z( 0.0 );
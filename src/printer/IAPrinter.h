@@ -94,6 +94,14 @@ public:
 
     IAControllerList pSceneSettings;
     IAFloatProperty layerHeight { "layerHeight", 0.3 };
+    IAFloatProperty rasterPitch { "rasterPitch", 0.05 }; // mm per pixel
+    IAIntProperty traceThreads { "traceThreads", 0 }; // 0=one per core, 1=no threads
+    IAFloatProperty traceTolerance { "traceTolerance", 0.05 }; // mm, for IAFramebuffer::MARCHING_SQUARES
+
+    int rasterWidth();
+    int rasterHeight();
+    int numTraceThreads();
+    virtual double curveTolerance();
 
     // ----
 
@@ -107,6 +115,7 @@ protected:
 
 private:
     void userChangedLayerHeight();
+    int rasterSize(double length);
 
 };
 
@@ -13,6 +13,7 @@
 #include "Iota.h"
 #include "opengl/IAFramebuffer.h"
 #include "printer/IAFDMPrinter.h"
+#include "toolpath/IATravelOptimizer.h"
 
 #include <FL/gl.h>
 
@@ -22,9 +23,11 @@
 
 bool isBlack(uint8_t *rgb, IAVector3d v)
 {
-    IAVector3d s = v * (kFramebufferSize / 214.0);
-    int xo = (int)s.x(), yo = (int)s.y();
-    uint8_t *c = rgb + (xo+kFramebufferSize*yo)*3;
+    IAPrinter *printer = Iota.pCurrentPrinter;
+    int w = printer->rasterWidth(), h = printer->rasterHeight();
+    int xo = (int)(v.x()/printer->pPrintVolume.x()*w);
+    int yo = (int)(v.y()/printer->pPrintVolume.y()*h);
+    uint8_t *c = rgb + (xo+w*yo)*3;
     if (c[0]<128 && c[1]<128 && c[2]<128) {
         return true;
     } else {
@@ -86,9 +89,11 @@ void IAToolpath::colorize(uint8_t *rgb, IAToolpath *black, IAToolpath *white)
 
 uint32_t getRGB(uint8_t *rgb, IAVector3d v)
 {
-    IAVector3d s = v * (kFramebufferSize / 214.0);
-    int xo = (int)s.x(), yo = (int)s.y();
-    uint8_t *c = rgb + (xo+kFramebufferSize*yo)*3;
+    IAPrinter *printer = Iota.pCurrentPrinter;
+    int w = printer->rasterWidth(), h = printer->rasterHeight();
+    int xo = (int)(v.x()/printer->pPrintVolume.x()*w);
+    int yo = (int)(v.y()/printer->pPrintVolume.y()*h);
+    uint8_t *c = rgb + (xo+w*yo)*3;
     return ((c[0]<<16)|(c[1]<<8)|(c[2]));
 }
 
@@ -208,10 +213,17 @@ void IAMachineToolpath::drawLayer(double z)
 }
 
 
+/**
+ * Optimize the travel in all layers.
+ *
+ * Every layer starts where the head stopped in the layer below.
+ */
 void IAMachineToolpath::optimize()
 {
+    IAVector3d position(0.0, 0.0, 0.0);
+    int seam = pPrinter->seamPlacement();
     for (auto &p: pToolpathListMap) {
-        p.second->optimize();
+        p.second->optimize(position, seam);
     }
 }
 
@@ -402,6 +414,9 @@ void IAToolpathList::move(IAToolpathList *tl)
 
 /**
  * Add another toolpath list to the list.
+ *
+ * The toolpaths are cloned, but the clones share their vertices with the
+ * original, so only the attributes are copied.
  */
 void IAToolpathList::add(IAToolpathList *tl, int tool, int group, int priority)
 {
@@ -494,49 +509,194 @@ void IAToolpathList::saveDXF(const char *filename)
 }
 
 
-void IAToolpathList::optimize()
+/**
+ * Sort toolpaths by tool, group, and priority, and then minimize the travel
+ * between toolpaths that have the same tool, group, and priority.
+ *
+ * \param position the head starts here; receives the position of the head
+ *      at the end of the layer
+ * \param seam where loops start, see IAToolpathLoop::Seam
+ */
+void IAToolpathList::optimize(IAVector3d &position, int seam)
 {
-    std::sort(pToolpathList.begin(), pToolpathList.end(), IAToolpath::comparePriorityAscending);
-    // -- optimize my travel distance: if Toolpaths are in the same group,
-    // with the same priority, and the same tool, sort them so that traveling
-    // between toolpaths is short
-    size_t i, j, n = pToolpathList.size();
-    if (n) for (i=0; i<n-1; i++) {
+    std::stable_sort(pToolpathList.begin(), pToolpathList.end(), IAToolpath::comparePriorityAscending);
+    IATravelOptimizer travel((IAToolpathLoop::Seam)seam);
+    size_t i = 0, n = pToolpathList.size();
+    while (i<n) {
         IAToolpath *ta = pToolpathList[i];
-        IAToolpath *tx = pToolpathList[i+1];
-        size_t x = i+1;
-        if (   ta->pGroup==tx->pGroup
-            && ta->pPriority==tx->pPriority
-            && ta->pTool==tx->pTool)
-        {
-            double dist = (ta->tFirst-tx->tFirst).length();
-            for (j=i+2; j<n; j++) {
-                IAToolpath *tb = pToolpathList[j];
-                if (   ta->pGroup==tb->pGroup
-                    && ta->pPriority==tb->pPriority
-                    && ta->pTool==tx->pTool )
-                {
-                    double dist2 = (ta->tFirst-tb->tFirst).length();
-                    if (dist2<dist) {
-                        dist = dist2;
-                        tx = tb;
-                        x = j;
-                    }
-                } else {
-                    break;
-                }
-            }
-            if (x!=i+1) {
-                IAToolpath *tmp = pToolpathList[x];
-                pToolpathList[x] = pToolpathList[i+1];
-                pToolpathList[i+1] = tmp;
-            }
-        }
+        size_t j = i+1;
+        while (   j<n
+               && ta->pTool==pToolpathList[j]->pTool
+               && ta->pGroup==pToolpathList[j]->pGroup
+               && ta->pPriority==pToolpathList[j]->pPriority)
+            j++;
+        travel.optimize(pToolpathList, i, j, position);
+        i = j;
     }
 }
 
 
 
+#ifdef __APPLE__
+#pragma mark -
+#endif
+// =============================================================================
+
+
+/**
+ * Draw a single motion into the scene viewer.
+ *
+ * \todo make the extrusion hexagonal so we can represent the squashing
+ *       by the layer height. Also, use the current E factor to calculate the
+ *       expected width of the extrusion and draw that.
+ * \todo add lids or connecotrs to the next extrusion.
+ * \todo this should be cached
+ */
+static void drawSegment(const IAVector3d &a, const IAVector3d &b, bool rapid)
+{
+#ifdef RENDER_HEX_TOOLPATH
+    if (rapid) {
+//        glDisable(GL_LIGHTING);
+//        glColor3f(1.0, 1.0, 0.0);
+//        glEnable(GL_LIGHTING);
+    } else {
+        double r=0.2;
+        IAVector3d d = (b - a).normalized();
+        IAVector3d n0 = { d.y(), -d.x(), 0.0 };
+        IAVector3d n1 = { 0.0, 0.0, 1.0 };
+        IAVector3d n2 = { -d.y(), d.x(), 0.0 };
+        IAVector3d n3 = { 0.0, 0.0, -1.0 };
+        IAVector3d p0, p1, p2, p3;
+
+        glBegin(GL_QUADS);
+        glNormal3dv(n0.dataPointer());
+        p0 = a + n0*r; glVertex3dv(p0.dataPointer());
+        glNormal3dv(n0.dataPointer());
+        p1 = b + n0*r; glVertex3dv(p1.dataPointer());
+        glNormal3dv(n1.dataPointer());
+        p2 = b + n1*r; glVertex3dv(p2.dataPointer());
+        glNormal3dv(n1.dataPointer());
+        p3 = a + n1*r; glVertex3dv(p3.dataPointer());
+        glEnd();
+
+        glBegin(GL_QUADS);
+        glNormal3dv(n1.dataPointer());
+        p0 = a + n1*r; glVertex3dv(p0.dataPointer());
+        glNormal3dv(n1.dataPointer());
+        p1 = b + n1*r; glVertex3dv(p1.dataPointer());
+        glNormal3dv(n2.dataPointer());
+        p2 = b + n2*r; glVertex3dv(p2.dataPointer());
+        glNormal3dv(n2.dataPointer());
+        p3 = a + n2*r; glVertex3dv(p3.dataPointer());
+        glEnd();
+
+        glBegin(GL_QUADS);
+        glNormal3dv(n2.dataPointer());
+        p0 = a + n2*r; glVertex3dv(p0.dataPointer());
+        glNormal3dv(n2.dataPointer());
+        p1 = b + n2*r; glVertex3dv(p1.dataPointer());
+        glNormal3dv(n3.dataPointer());
+        p2 = b + n3*r; glVertex3dv(p2.dataPointer());
+        glNormal3dv(n3.dataPointer());
+        p3 = a + n3*r; glVertex3dv(p3.dataPointer());
+        glEnd();
+
+        glBegin(GL_QUADS);
+        glNormal3dv(n3.dataPointer());
+        p0 = a + n3*r; glVertex3dv(p0.dataPointer());
+        glNormal3dv(n3.dataPointer());
+        p1 = b + n3*r; glVertex3dv(p1.dataPointer());
+        glNormal3dv(n0.dataPointer());
+        p2 = b + n0*r; glVertex3dv(p2.dataPointer());
+        glNormal3dv(n0.dataPointer());
+        p3 = a + n0*r; glVertex3dv(p3.dataPointer());
+        glEnd();
+
+    }
+#else
+    if (rapid) {
+        glLineWidth(1.0);
+        glColor3f(1.0, 1.0, 0.0);
+    } else {
+        glLineWidth(2.0);
+        glColor3f(1.0, 0.0, 1.0);
+    }
+    glBegin(GL_LINES);
+    glVertex3dv(a.dataPointer());
+    glVertex3dv(b.dataPointer());
+    glEnd();
+    glLineWidth(1.0);
+#endif
+}
+
+
+/**
+ * Draw a single extrusion into the scene viewer as a flat polygon.
+ */
+static void drawFlatSegment(const IAVector3d &a, const IAVector3d &b, double w)
+{
+#if 1
+    /**
+     \todo this should draw a cap depending on the previous line.
+     \todo this is the brute force approach which could be made so much
+     faster. This approach just draws an octagon, extende by a line.
+     */
+    IAVector3d d = b - a;
+    IAVector3d u = d.normalized();
+    double xo = u.x() * w * 0.5, x7 = xo * 0.7;
+    double yo = u.y() * w * 0.5, y7 = yo * 0.7;;
+    glBegin(GL_POLYGON);
+    glVertex3d(a.x()-xo, a.y()-yo, a.z());
+    glVertex3d(a.x()-x7-y7, a.y()-y7+x7, a.z());
+    glVertex3d(a.x()-yo, a.y()+xo, a.z());
+    glVertex3d(b.x()-yo, b.y()+xo, b.z());
+    glVertex3d(b.x()+x7-y7, b.y()+y7+x7, b.z());
+    glVertex3d(b.x()+xo, b.y()+yo, b.z());
+    glVertex3d(b.x()+x7+y7, b.y()+y7-x7, b.z());
+    glVertex3d(b.x()+yo, b.y()-xo, b.z());
+    glVertex3d(a.x()+yo, a.y()-xo, a.z());
+    glVertex3d(a.x()-x7+y7, a.y()-y7-x7, a.z());
+    glEnd();
+#else
+    /** \bug line width! */
+    glBegin(GL_LINES);
+    glVertex3dv(a.dataPointer());
+    glVertex3dv(b.dataPointer());
+    glEnd();
+#endif
+}
+
+
+/**
+ * Draw a single extrusion into a framebuffer as a flat polygon.
+ */
+static void drawFlatSegmentToBitmap(IAFramebuffer *fb, const IAVector3d &a,
+                                    const IAVector3d &b, double w, int color)
+{
+    /**
+     \todo this should draw a cap depending on the previous line.
+     \todo this is the brute force approach which could be made so much
+     faster. This approach just draws an octagon, extende by a line.
+     */
+    IAVector3d d = b - a;
+    IAVector3d u = d.normalized();
+    double xo = u.x() * w * 0.5, x7 = xo * 0.7;
+    double yo = u.y() * w * 0.5, y7 = yo * 0.7;;
+    fb->beginComplexPolygon();
+    fb->addPoint(a.x()-xo, a.y()-yo);
+    fb->addPoint(a.x()-x7-y7, a.y()-y7+x7);
+    fb->addPoint(a.x()-yo, a.y()+xo);
+    fb->addPoint(b.x()-yo, b.y()+xo);
+    fb->addPoint(b.x()+x7-y7, b.y()+y7+x7);
+    fb->addPoint(b.x()+xo, b.y()+yo);
+    fb->addPoint(b.x()+x7+y7, b.y()+y7-x7);
+    fb->addPoint(b.x()+yo, b.y()-xo);
+    fb->addPoint(a.x()+yo, a.y()-xo);
+    fb->addPoint(a.x()-x7+y7, a.y()-y7-x7);
+    fb->endComplexPolygon(color);
+}
+
+
 #ifdef __APPLE__
 #pragma mark -
 #endif
@@ -566,6 +726,10 @@ IAToolpath::~IAToolpath()
 /**
  * Create a duplicate of this Toolpath.
  *
+ * The duplicate shares the vertices with this toolpath, so cloning is cheap
+ * no matter how long the path is. Tool, group, and priority are copied and
+ * can be changed independently.
+ *
  * \param[in] t is set if the object was already created by a derived class.
  * \return a copy of this toolpath, caller must \em delete
  */
@@ -579,8 +743,7 @@ IAToolpath *IAToolpath::clone(IAToolpath *t)
     t->pTool = pTool;
     t->pGroup = pGroup;
     t->pPriority = pPriority;
-    for (auto &e: pElementList)
-        t->pElementList.push_back(e->clone());
+    t->pVertexList = pVertexList;
     return t;
 }
 
@@ -590,14 +753,39 @@ IAToolpath *IAToolpath::clone(IAToolpath *t)
  */
 void IAToolpath::purge()
 {
-    for (auto &el: pElementList)
-        delete el;
-    pElementList.clear();
+    pVertexList = nullptr;
     tFirst = { 0.0, 0.0, pZ };
     tPrev = { 0.0, 0.0, pZ };
 }
 
 
+/**
+ * Return the vertices of this toolpath for reading.
+ */
+const IAToolpathVertexList &IAToolpath::vertices() const
+{
+    static const IAToolpathVertexList empty;
+    return pVertexList ? *pVertexList : empty;
+}
+
+
+/**
+ * Return the vertices of this toolpath for writing.
+ *
+ * Toolpaths do not change once they are built, so clones share their
+ * vertices. If another toolpath still uses the vertices, this toolpath
+ * gets its own copy first.
+ */
+IAToolpathVertexList &IAToolpath::editVertices()
+{
+    if (!pVertexList)
+        pVertexList = std::make_shared<IAToolpathVertexList>();
+    else if (pVertexList.use_count()>1)
+        pVertexList = std::make_shared<IAToolpathVertexList>(*pVertexList);
+    return *pVertexList;
+}
+
+
 bool IAToolpath::comparePriorityAscending(const IAToolpath *a, const IAToolpath *b)
 {
     // first, sort by the extruder index
@@ -631,8 +819,15 @@ void IAToolpath::draw()
         case  0: glColor3f(1.0, 1.0, 1.0); break;
         case  1: glColor3f(0.3, 0.3, 0.3); break;
     }
-    for (auto &e: pElementList) {
-        e->draw();
+    IAVector3d prev(0.0, 0.0, pZ);
+    for (auto &v: vertices()) {
+        IAVector3d next(v.x, v.y, pZ);
+        if (v.isColored()) {
+            uint32_t c = v.color();
+            glColor3ub(c>>16, c>>8, c);
+        }
+        drawSegment(prev, next, v.isRapid());
+        prev = next;
     }
 }
 
@@ -642,8 +837,12 @@ void IAToolpath::drawFlat(double w)
     /**
      \todo draw connection between lines.
      */
-    for (auto &e: pElementList) {
-        e->drawFlat(w);
+    IAVector3d prev(0.0, 0.0, pZ);
+    for (auto &v: vertices()) {
+        IAVector3d next(v.x, v.y, pZ);
+        if (!v.isRapid())
+            drawFlatSegment(prev, next, w);
+        prev = next;
     }
 }
 
@@ -653,8 +852,12 @@ void IAToolpath::drawFlatToBitmap(IAFramebuffer *fb, double w, int color)
     /**
      \todo draw connection between lines.
      */
-    for (auto &e: pElementList) {
-        e->drawFlatToBitmap(fb, w, color);
+    IAVector3d prev(0.0, 0.0, pZ);
+    for (auto &v: vertices()) {
+        IAVector3d next(v.x, v.y, pZ);
+        if (!v.isRapid())
+            drawFlatSegmentToBitmap(fb, prev, next, w, color);
+        prev = next;
     }
 }
 
@@ -666,7 +869,7 @@ void IAToolpath::startPath(double x, double y)
 {
     IAVector3d next(x, y, pZ);
     tFirst = next;
-    pElementList.push_back(new IAToolpathMotion(tPrev, next, true));
+    editVertices().push_back( IAToolpathVertex(x, y, IAToolpathVertex::RAPID) );
     tPrev = next;
 }
 
@@ -678,18 +881,59 @@ void IAToolpath::continuePath(double x, double y)
 {
     IAVector3d next(x, y, pZ);
     if (!(tPrev==next))
-        pElementList.push_back(new IAToolpathMotion(tPrev, next));
+        editVertices().push_back( IAToolpathVertex(x, y) );
     tPrev = next;
 }
 
 
+/**
+ * Add a motion segment to every point in an array.
+ *
+ * \param xy n points as pairs of x and y coordinates
+ * \param n number of points
+ */
+void IAToolpath::continuePath(const double *xy, size_t n)
+{
+    IAToolpathVertexList &list = editVertices();
+    list.reserve(list.size()+n+1);
+    for (size_t i=0; i<n; i++, xy+=2)
+        continuePath(xy[0], xy[1]);
+}
+
+
 /**
  * Create a loop by moving back to the very first vector.
  */
 void IAToolpath::closePath()
 {
     if (!(tPrev==tFirst))
-        pElementList.push_back(new IAToolpathMotion(tPrev, tFirst));
+        editVertices().push_back( IAToolpathVertex(tFirst.x(), tFirst.y()) );
+}
+
+
+/**
+ * Print this toolpath backwards.
+ *
+ * Every motion runs in the opposite direction, and the head moves rapidly
+ * to the last point first.
+ */
+void IAToolpath::reverse()
+{
+    const IAToolpathVertexList &src = vertices();
+    size_t n = src.size();
+    if (n<2) return;
+    IAToolpathVertexListSP dst = std::make_shared<IAToolpathVertexList>();
+    dst->reserve(n);
+    dst->push_back( IAToolpathVertex(src[n-1].x, src[n-1].y, IAToolpathVertex::RAPID) );
+    for (size_t i=1; i<n; i++) {
+        // the flags belong to the motion that ends at a vertex
+        IAToolpathVertex v = src[n-1-i];
+        v.flags = src[n-i].flags;
+        dst->push_back(v);
+    }
+    pVertexList = dst;
+    tFirst = { dst->front().x, dst->front().y, pZ };
+    tPrev = { dst->back().x, dst->back().y, pZ };
 }
 
 
@@ -709,8 +953,17 @@ unsigned int IAToolpath::createToolmap()
 void IAToolpath::saveGCode(IAGcodeWriter &w)
 {
     w.requestTool(pTool);
-    for (auto &e: pElementList) {
-        e->saveGCode(w);
+    IAVector3d prev(0.0, 0.0, pZ);
+    for (auto &v: vertices()) {
+        IAVector3d next(v.x, v.y, pZ);
+        if (v.isRapid()) {
+            w.cmdRetractMove(next);
+        } else {
+            if (w.position()!=prev)
+                w.cmdRetractMove(prev);
+            w.cmdPrintMove(next);
+        }
+        prev = next;
     }
 }
 
@@ -720,8 +973,12 @@ void IAToolpath::saveGCode(IAGcodeWriter &w)
  */
 void IAToolpath::saveDXF(IADxfWriter &w)
 {
-    for (auto &e: pElementList) {
-        e->saveDXF(w);
+    IAVector3d prev(0.0, 0.0, pZ);
+    for (auto &v: vertices()) {
+        IAVector3d next(v.x, v.y, pZ);
+        if (!v.isRapid())
+            w.cmdLine(prev, next);
+        prev = next;
     }
 }
 
@@ -751,111 +1008,90 @@ IAToolpath *IAToolpathLoop::clone(IAToolpath *t)
 }
 
 
-#ifdef __APPLE__
-#pragma mark -
-#endif
-// =============================================================================
-
-
 /**
- * Create any sort of toolpath element.
+ * Check if the loop is a single closed path that can start at any vertex.
  */
-IAToolpathElement::IAToolpathElement()
+bool IAToolpathLoop::isClosed() const
 {
+    const IAToolpathVertexList &v = vertices();
+    size_t n = v.size();
+    if (n<4 || v[0].x!=v[n-1].x || v[0].y!=v[n-1].y)
+        return false;
+    for (size_t i=1; i<n; i++)
+        if (v[i].isRapid()) return false;
+    return true;
 }
 
 
 /**
- * Destroy an element.
+ * Find the best vertex to start the loop.
+ *
+ * \param seam how to choose the vertex
+ * \param x, y the head position, used for Seam::NEAREST
+ * \return index of the vertex, or 0 if the loop is not closed
  */
-IAToolpathElement::~IAToolpathElement()
-{
-}
-
-
-IAToolpathElement *IAToolpathElement::clone()
+size_t IAToolpathLoop::findSeam(Seam seam, double x, double y) const
 {
-    return new IAToolpathElement();
+    if (!isClosed()) return 0;
+    const IAToolpathVertexList &v = vertices();
+    // the last vertex is the same as the first one
+    size_t n = v.size()-1, best = 0;
+    switch (seam) {
+        case NEAREST: {
+            double bestDist = HUGE_VAL;
+            for (size_t i=0; i<n; i++) {
+                double dx = v[i].x-x, dy = v[i].y-y;
+                double d = dx*dx + dy*dy;
+                if (d<bestDist) { bestDist = d; best = i; }
+            }
+            break; }
+        case ALIGNED:
+            for (size_t i=1; i<n; i++) {
+                if (v[i].y>v[best].y || (v[i].y==v[best].y && v[i].x<v[best].x))
+                    best = i;
+            }
+            break;
+        case CORNER: {
+            double bestScore = -1.0;
+            for (size_t i=0; i<n; i++) {
+                const IAToolpathVertex &a = v[(i+n-1)%n], &b = v[i], &c = v[i+1];
+                double ux = b.x-a.x, uy = b.y-a.y, wx = c.x-b.x, wy = c.y-b.y;
+                double turn = atan2(ux*wy - uy*wx, ux*wx + uy*wy);
+                // the tracers keep the material on the left of every loop,
+                // outlines and holes alike, so an inside corner of the part
+                // is always a right turn
+                double score = fabs(turn);
+                if (turn<0.0) score += M_PI;
+                if (score>bestScore) { bestScore = score; best = i; }
+            }
+            break; }
+    }
+    return best;
 }
 
 
 /**
- * Draw any element.
+ * Start the loop at another vertex.
+ *
+ * The loop keeps its shape and direction. If other toolpaths share the
+ * vertices, this loop gets its own copy first.
+ *
+ * \param i index of the new first vertex, as returned by findSeam()
  */
-void IAToolpathElement::draw()
+void IAToolpathLoop::moveSeam(size_t i)
 {
-    // nothing to here
+    if (i==0 || !isClosed()) return;
+    IAToolpathVertexList &v = editVertices();
+    // the flags of a vertex belong to the motion that ends there, so they
+    // move with the vertex
+    std::rotate(v.begin()+1, v.begin()+i+1, v.end());
+    v[0].x = v.back().x;
+    v[0].y = v.back().y;
+    tFirst = { v[0].x, v[0].y, pZ };
+    tPrev = tFirst;
 }
 
 
-//#ifdef __APPLE__
-//#pragma mark -
-//#endif
-//// =============================================================================
-//
-//
-//
-///**
-// * Create any sort of toolpath element.
-// */
-//IAToolpathExtruder::IAToolpathExtruder(int tool)
-//:   pTool( tool )
-//{
-//}
-//
-//
-///**
-// * Destroy an element.
-// */
-//IAToolpathExtruder::~IAToolpathExtruder()
-//{
-//}
-//
-//
-//IAToolpathElement *IAToolpathExtruder::clone()
-//{
-//    IAToolpathExtruder *tpe = new IAToolpathExtruder(pTool);
-//    return tpe;
-//}
-//
-//
-///**
-// * Save the toolpath element as a GCode file.
-// */
-//void IAToolpathExtruder::saveGCode(IAGcodeWriter &w)
-//{
-//    assert(0); // this must be implemented again
-//#if 0
-//    w.cmdComment("");
-//    w.cmdComment("---- Change to extruder %d", pTool);
-//    // deactivate the other extruder
-//    int otherTool = 1-pTool;
-//    w.cmdSelectExtruder(otherTool);
-//    w.cmdResetExtruder();
-//    w.cmdExtrude(-4.0);
-//
-//    // activate the new extruder
-//    w.cmdSelectExtruder(pTool);
-//    w.cmdResetExtruder();
-//    w.cmdExtrude(4.0);
-//    int x = pTool ? 100 : 48;
-//    int pw = 20;
-//    w.cmdRapidMove(x, 10.0);
-//    int i;
-//    for (i=0; i<4; i++) {
-//        w.cmdPrintMove(x+pw, 10.0+i);
-//        w.cmdPrintMove(x+pw, 10.0+i+0.5);
-//        w.cmdMove(x, 10.0+i+0.5);
-//        w.cmdMove(x, 10.0+i+1.0);
-//    }
-//    w.cmdSelectExtruder(pTool); // redundant
-//    w.cmdResetExtruder();
-//    w.cmdComment("Extruder %d ready", pTool);
-//    w.cmdComment("");
-//#endif
-//}
-
-
 #ifdef __APPLE__
 #pragma mark -
 #endif
@@ -863,218 +1099,22 @@ void IAToolpathElement::draw()
 
 
 /**
- * Create a toolpath for a head motion to a new position.
- */
-IAToolpathMotion::IAToolpathMotion(IAVector3d &a, IAVector3d &b, bool rapid)
-:   IAToolpathElement(),
-    pStart( a ),
-    pEnd( b ),
-    pIsRapid( rapid )
-{
-}
-
-
-IAToolpathElement *IAToolpathMotion::clone()
-{
-    IAToolpathMotion *mtn = new IAToolpathMotion(pStart, pEnd, pIsRapid);
-    mtn->pColor = pColor;
-    return mtn;
-}
-
-
-/**
- * Draw the toolpath motion into the scene viewer.
- *
- * \todo make the extrusion hexagonal so we can represent the squashing
- *       by the layer height. Also, use the current E factor to calculate the
- *       expected width of the extrusion and draw that.
- * \todo add lids or connecotrs to the next extrusion.
- * \todo this should be cached
- */
-void IAToolpathMotion::draw()
-{
-#ifdef RENDER_HEX_TOOLPATH
-    if (pIsRapid) {
-//        glDisable(GL_LIGHTING);
-//        glColor3f(1.0, 1.0, 0.0);
-//        glEnable(GL_LIGHTING);
-    } else {
-        double r=0.2;
-        IAVector3d d = (pEnd - pStart).normalized();
-        IAVector3d n0 = { d.y(), -d.x(), 0.0 };
-        IAVector3d n1 = { 0.0, 0.0, 1.0 };
-        IAVector3d n2 = { -d.y(), d.x(), 0.0 };
-        IAVector3d n3 = { 0.0, 0.0, -1.0 };
-        IAVector3d p0, p1, p2, p3;
-
-        if (pColor!=0xFFFFFFFF)
-            glColor3ub(pColor>>16, pColor>>8, pColor);
-
-        glBegin(GL_QUADS);
-        glNormal3dv(n0.dataPointer());
-        p0 = pStart + n0*r; glVertex3dv(p0.dataPointer());
-        glNormal3dv(n0.dataPointer());
-        p1 = pEnd + n0*r; glVertex3dv(p1.dataPointer());
-        glNormal3dv(n1.dataPointer());
-        p2 = pEnd + n1*r; glVertex3dv(p2.dataPointer());
-        glNormal3dv(n1.dataPointer());
-        p3 = pStart + n1*r; glVertex3dv(p3.dataPointer());
-        glEnd();
-
-        glBegin(GL_QUADS);
-        glNormal3dv(n1.dataPointer());
-        p0 = pStart + n1*r; glVertex3dv(p0.dataPointer());
-        glNormal3dv(n1.dataPointer());
-        p1 = pEnd + n1*r; glVertex3dv(p1.dataPointer());
-        glNormal3dv(n2.dataPointer());
-        p2 = pEnd + n2*r; glVertex3dv(p2.dataPointer());
-        glNormal3dv(n2.dataPointer());
-        p3 = pStart + n2*r; glVertex3dv(p3.dataPointer());
-        glEnd();
-
-        glBegin(GL_QUADS);
-        glNormal3dv(n2.dataPointer());
-        p0 = pStart + n2*r; glVertex3dv(p0.dataPointer());
-        glNormal3dv(n2.dataPointer());
-        p1 = pEnd + n2*r; glVertex3dv(p1.dataPointer());
-        glNormal3dv(n3.dataPointer());
-        p2 = pEnd + n3*r; glVertex3dv(p2.dataPointer());
-        glNormal3dv(n3.dataPointer());
-        p3 = pStart + n3*r; glVertex3dv(p3.dataPointer());
-        glEnd();
-
-        glBegin(GL_QUADS);
-        glNormal3dv(n3.dataPointer());
-        p0 = pStart + n3*r; glVertex3dv(p0.dataPointer());
-        glNormal3dv(n3.dataPointer());
-        p1 = pEnd + n3*r; glVertex3dv(p1.dataPointer());
-        glNormal3dv(n0.dataPointer());
-        p2 = pEnd + n0*r; glVertex3dv(p2.dataPointer());
-        glNormal3dv(n0.dataPointer());
-        p3 = pStart + n0*r; glVertex3dv(p3.dataPointer());
-        glEnd();
-
-    }
-#else
-    if (pIsRapid) {
-        glLineWidth(1.0);
-        glColor3f(1.0, 1.0, 0.0);
-    } else {
-        glLineWidth(2.0);
-        glColor3f(1.0, 0.0, 1.0);
-    }
-    glBegin(GL_LINES);
-    glVertex3dv(pStart.dataPointer());
-    glVertex3dv(pEnd.dataPointer());
-    glEnd();
-    glLineWidth(1.0);
-#endif
-}
-
-
-/**
- * Draw the toolpath motion into the scene viewer.
+ * An open toolpath that can be printed in either direction.
  */
-void IAToolpathMotion::drawFlat(double w)
-{
-    if (!pIsRapid) {
-#if 1
-        /**
-         \todo this should draw a cap depending on the previous line.
-         \todo this is the brute force approach which could be made so much
-         faster. This approach just draws an octagon, extende by a line.
-         */
-        IAVector3d d = pEnd - pStart;
-        IAVector3d u = d.normalized();
-        double xo = u.x() * w * 0.5, x7 = xo * 0.7;
-        double yo = u.y() * w * 0.5, y7 = yo * 0.7;;
-        glBegin(GL_POLYGON);
-        glVertex3d(pStart.x()-xo, pStart.y()-yo, pStart.z());
-        glVertex3d(pStart.x()-x7-y7, pStart.y()-y7+x7, pStart.z());
-        glVertex3d(pStart.x()-yo, pStart.y()+xo, pStart.z());
-        glVertex3d(pEnd.x()-yo, pEnd.y()+xo, pEnd.z());
-        glVertex3d(pEnd.x()+x7-y7, pEnd.y()+y7+x7, pEnd.z());
-        glVertex3d(pEnd.x()+xo, pEnd.y()+yo, pEnd.z());
-        glVertex3d(pEnd.x()+x7+y7, pEnd.y()+y7-x7, pEnd.z());
-        glVertex3d(pEnd.x()+yo, pEnd.y()-xo, pEnd.z());
-        glVertex3d(pStart.x()+yo, pStart.y()-xo, pStart.z());
-        glVertex3d(pStart.x()-x7+y7, pStart.y()-y7-x7, pStart.z());
-        glEnd();
-#else
-        /** \bug line width! */
-        glBegin(GL_LINES);
-        glVertex3dv(pStart.dataPointer());
-        glVertex3dv(pEnd.dataPointer());
-        glEnd();
-#endif
-    }
-}
-
-
-/**
- * Draw the toolpath motion into the scene viewer.
- */
-void IAToolpathMotion::drawFlatToBitmap(IAFramebuffer *fb, double w, int color)
+IAToolpathLine::IAToolpathLine(double z)
+:   IAToolpath( z )
 {
-    if (!pIsRapid) {
-        /**
-         \todo this should draw a cap depending on the previous line.
-         \todo this is the brute force approach which could be made so much
-         faster. This approach just draws an octagon, extende by a line.
-         */
-        IAVector3d d = pEnd - pStart;
-        IAVector3d u = d.normalized();
-        double xo = u.x() * w * 0.5, x7 = xo * 0.7;
-        double yo = u.y() * w * 0.5, y7 = yo * 0.7;;
-        fb->beginComplexPolygon();
-        fb->addPoint(pStart.x()-xo, pStart.y()-yo);
-        fb->addPoint(pStart.x()-x7-y7, pStart.y()-y7+x7);
-        fb->addPoint(pStart.x()-yo, pStart.y()+xo);
-        fb->addPoint(pEnd.x()-yo, pEnd.y()+xo);
-        fb->addPoint(pEnd.x()+x7-y7, pEnd.y()+y7+x7);
-        fb->addPoint(pEnd.x()+xo, pEnd.y()+yo);
-        fb->addPoint(pEnd.x()+x7+y7, pEnd.y()+y7-x7);
-        fb->addPoint(pEnd.x()+yo, pEnd.y()-xo);
-        fb->addPoint(pStart.x()+yo, pStart.y()-xo);
-        fb->addPoint(pStart.x()-x7+y7, pStart.y()-y7-x7);
-        fb->endComplexPolygon(color);
-    }
 }
 
 
-/**
- * Save the toolpath element as a GCode file.
- */
-void IAToolpathMotion::saveGCode(IAGcodeWriter &w)
+IAToolpathLine::~IAToolpathLine()
 {
-    if (pIsRapid) {
-        w.cmdRetractMove(pEnd);
-//        bool retract = ((pEnd-pStart).length() > 5.0);
-//        if (retract) w.cmdRetract();
-//        w.cmdRapidMove(pEnd);
-//        if (retract) w.cmdUnretract();
-    } else {
-        if (w.position()!=pStart) {
-            w.cmdRetractMove(pStart);
-//            bool retract = ((w.position()-pStart).length() > 5.0);
-//            if (retract) w.cmdRetract();
-//            w.cmdRapidMove(pStart);
-//            if (retract) w.cmdUnretract();
-        }
-        w.cmdPrintMove(pEnd);
-    }
 }
 
 
-/**
- * Save the toolpath element as line in a DXF file.
- */
-void IAToolpathMotion::saveDXF(IADxfWriter &g)
+IAToolpath *IAToolpathLine::clone(IAToolpath *t)
 {
-    if (!pIsRapid) {
-        g.cmdLine(pStart, pEnd);
-    }
+    if (!t)
+        t = new IAToolpathLine(pZ);
+    return super::clone(t);
 }
-
-
-
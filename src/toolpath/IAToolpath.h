@@ -19,14 +19,15 @@
 
 class IAToolpathList;
 class IAToolpath;
-class IAToolpathElement;
+struct IAToolpathVertex;
 class IAFramebuffer;
 class IAFDMPrinter;
 
 
 typedef std::map<int, IAToolpathList*> IAToolpathListMap;
 typedef std::vector<IAToolpath*> IAToolpathTypeList;
-typedef std::vector<IAToolpathElement*> IAToolpathElementList;
+typedef std::vector<IAToolpathVertex> IAToolpathVertexList;
+typedef std::shared_ptr<IAToolpathVertexList> IAToolpathVertexListSP;
 typedef std::shared_ptr<IAToolpathList> IAToolpathListSP;
 typedef std::shared_ptr<IAToolpath> IAToolpathTypeSP;
 
@@ -94,7 +95,7 @@ public:
 
     bool isEmpty();
 
-    void optimize();
+    void optimize(IAVector3d &position, int seam=0);
 
     unsigned int createToolmap();
 
@@ -110,6 +111,38 @@ public:
 };
 
 
+/**
+ * A point in a toolpath.
+ *
+ * The head moves in a straight line from the previous vertex to this one.
+ * All vertices of a toolpath share the z position of the toolpath, and
+ * single precision is still accurate to a fraction of a micron on any
+ * printer bed. At twelve bytes, a vertex is a lot smaller than a separately
+ * allocated segment object, and writers can walk the list without any
+ * virtual calls.
+ */
+struct IAToolpathVertex
+{
+    enum {
+        /** Move to this vertex without extruding */
+        RAPID = 0x01,
+        /** The upper 24 bits of the flags hold an RGB color */
+        COLORED = 0x02
+    };
+
+    IAToolpathVertex(double x_, double y_, uint32_t flags_=0)
+    :   x( (float)x_ ), y( (float)y_ ), flags( flags_ ) { }
+
+    bool isRapid() const { return (flags & RAPID) != 0; }
+    bool isColored() const { return (flags & COLORED) != 0; }
+    uint32_t color() const { return flags>>8; }
+    void setColor(uint32_t c) { flags = (flags & RAPID) | COLORED | (c<<8); }
+
+    float x, y;
+    uint32_t flags;
+};
+
+
 class IAToolpath
 {
 protected:
@@ -119,6 +152,7 @@ public:
 
     virtual ~IAToolpath();
     virtual IAToolpath *clone(IAToolpath *t=nullptr);
+    virtual bool canReverse() const { return false; }
 
     void purge();
     void setZ(double z) { pZ = z; tFirst.z(z); tPrev.z(z); }
@@ -126,11 +160,13 @@ public:
     void drawFlat(double w);
     void drawFlatToBitmap(IAFramebuffer*, double w, int color=0);
 
-    bool isEmpty() { return pElementList.empty(); }
+    bool isEmpty() const { return vertices().empty(); }
 
     void startPath(double x, double y);
     void continuePath(double x, double y);
+    void continuePath(const double *xy, size_t n);
     void closePath(void);
+    void reverse();
 
 //    void colorize(uint8_t *rgb, IAToolpath *black, IAToolpath *white);
 //    void colorizeSoft(uint8_t *rgb, IAToolpath *dst);
@@ -140,8 +176,11 @@ public:
     void saveGCode(IAGcodeWriter &g);
     void saveDXF(IADxfWriter &w);
 
-    IAToolpathElementList pElementList;
-    // list of elements
+    const IAToolpathVertexList &vertices() const;
+    IAToolpathVertexList &editVertices();
+
+    IAToolpathVertexListSP pVertexList;
+    // list of vertices, all at height pZ, shared by all clones of this path
 
     IAVector3d tFirst, tPrev;
     double pZ = 0.0;
@@ -155,9 +194,23 @@ class IAToolpathLoop : public IAToolpath
 {
     typedef IAToolpath super;
 public:
+    /** Where a loop starts and ends */
+    enum Seam {
+        /** Start close to the end of the previous toolpath */
+        NEAREST = 0,
+        /** Start at the rear of the loop, so seams line up across layers */
+        ALIGNED,
+        /** Start in the sharpest corner, preferably a concave one */
+        CORNER
+    };
+
     IAToolpathLoop(double z);
     virtual ~IAToolpathLoop() override;
     virtual IAToolpath *clone(IAToolpath *t=nullptr) override;
+
+    bool isClosed() const;
+    size_t findSeam(Seam seam, double x=0.0, double y=0.0) const;
+    void moveSeam(size_t i);
 };
 
 
@@ -168,67 +221,13 @@ public:
     IAToolpathLine(double z);
     virtual ~IAToolpathLine() override;
     virtual IAToolpath *clone(IAToolpath *t=nullptr) override;
+    virtual bool canReverse() const override { return true; }
 };
 
 
 
-/**
- * Base class for any element inside the tool path.
- */
-class IAToolpathElement
-{
-public:
-    IAToolpathElement();
-    virtual ~IAToolpathElement();
-    virtual void draw();
-    virtual void drawFlat(double w) { }
-    virtual void drawFlatToBitmap(IAFramebuffer*, double w, int color=0) { }
-    virtual void saveGCode(IAGcodeWriter &g) { }
-    virtual void saveDXF(IADxfWriter &g) { }
-    virtual IAToolpathElement *clone();
-};
-
-
-/**
- * Element changes to another extruder.
- */
-//class IAToolpathExtruder : public IAToolpathElement
-//{
-//public:
-//    IAToolpathExtruder(int i);
-//    virtual ~IAToolpathExtruder() override;
-//    virtual void draw() override { }
-//    virtual void drawFlat(double w) override { }
-//    virtual void saveGCode(IAGcodeWriter &g) override;
-//    virtual IAToolpathElement *clone() override;
-//
-//    int pTool = 0;
-//};
-
-
-/**
- * Toolpath element for extruder motion.
- */
-class IAToolpathMotion : public IAToolpathElement
-{
-public:
-    IAToolpathMotion(IAVector3d &a, IAVector3d &b, bool rapid=false);
-    virtual void draw() override;
-    virtual void drawFlat(double w) override;
-    virtual void drawFlatToBitmap(IAFramebuffer*, double w, int color=0) override;
-    virtual void saveGCode(IAGcodeWriter &g) override;
-    virtual void saveDXF(IADxfWriter &g) override;
-    virtual IAToolpathElement *clone() override;
-    void setColor(uint32_t c) { pColor = c; }
-
-    IAVector3d pStart, pEnd;
-    uint32_t pColor = 0xFFFFFFFF;
-    bool pIsRapid = false;
-};
-
-
 /*
- further elements could be
+ further vertex flags could be
   - tool change
   - tool cleaning
   - machine setup, bed heating, extruder heating, etc.
@@ -0,0 +1,265 @@
+//
+//  IATravelOptimizer.cpp
+//
+//  Copyright (c) 2013-2018 Matthias Melcher. All rights reserved.
+//
+
+
+#include "IATravelOptimizer.h"
+
+#include <math.h>
+#include <algorithm>
+
+
+/** Maximum number of toolpaths that 2-opt reverses at once */
+static const int kTwoOptWindow = 32;
+
+/** Maximum number of 2-opt passes over a group of toolpaths */
+static const int kTwoOptPasses = 4;
+
+
+static inline double distance(const IAVector3d &a, const IAVector3d &b)
+{
+    return hypot(a.x()-b.x(), a.y()-b.y());
+}
+
+
+/**
+ * Create a travel optimizer.
+ *
+ * \param seam where closed loops start
+ */
+IATravelOptimizer::IATravelOptimizer(IAToolpathLoop::Seam seam)
+:   pSeam( seam )
+{
+}
+
+
+/**
+ * Move the start of a closed loop to a better vertex.
+ *
+ * Does nothing if the path is not a closed loop.
+ *
+ * \param position the head position, used for IAToolpathLoop::NEAREST
+ */
+void IATravelOptimizer::moveSeam(Path &p, IAToolpathLoop::Seam seam, const IAVector3d &position)
+{
+    IAToolpathLoop *loop = dynamic_cast<IAToolpathLoop*>(p.toolpath);
+    if (!loop || !loop->isClosed()) return;
+    size_t i = loop->findSeam(seam, position.x(), position.y());
+    if (i==0) return;
+    loop->moveSeam(i);
+    const IAToolpathVertex &v = loop->vertices().front();
+    p.start = p.end = IAVector3d(v.x, v.y, loop->pZ);
+}
+
+
+/**
+ * Sort a k-d tree in place.
+ *
+ * Even depths split at x, odd depths split at y.
+ */
+void IATravelOptimizer::buildTree(int lo, int hi, int depth)
+{
+    if (lo>=hi) return;
+    int mid = (lo+hi)/2;
+    if (depth&1) {
+        std::nth_element(pTree.begin()+lo, pTree.begin()+mid, pTree.begin()+hi,
+                         [](const Endpoint &a, const Endpoint &b) { return a.y<b.y; });
+    } else {
+        std::nth_element(pTree.begin()+lo, pTree.begin()+mid, pTree.begin()+hi,
+                         [](const Endpoint &a, const Endpoint &b) { return a.x<b.x; });
+    }
+    pAlive[mid] = hi-lo;
+    buildTree(lo, mid, depth+1);
+    buildTree(mid+1, hi, depth+1);
+}
+
+
+/**
+ * Mark an endpoint as used, so it is no longer found.
+ *
+ * \param e position of the endpoint in pTree
+ */
+void IATravelOptimizer::removeEndpoint(int e)
+{
+    int lo = 0, hi = (int)pTree.size();
+    while (lo<hi) {
+        int mid = (lo+hi)/2;
+        pAlive[mid]--;
+        if (mid==e) break;
+        if (e<mid) hi = mid; else lo = mid+1;
+    }
+    pUsed[e] = 1;
+}
+
+
+/**
+ * Find the unused endpoint that is closest to a point.
+ *
+ * Subtrees without any unused endpoints are skipped, so the search stays
+ * fast while more and more endpoints are used up.
+ *
+ * \param best receives the position of the endpoint in pTree
+ * \param bestDist squared distance of the best endpoint so far
+ */
+void IATravelOptimizer::findNearest(int lo, int hi, int depth, double x, double y,
+                                    int &best, double &bestDist) const
+{
+    if (lo>=hi) return;
+    int mid = (lo+hi)/2;
+    if (pAlive[mid]==0) return;
+    const Endpoint &e = pTree[mid];
+    if (!pUsed[mid]) {
+        double dx = e.x-x, dy = e.y-y;
+        double d = dx*dx + dy*dy;
+        if (d<bestDist) { bestDist = d; best = mid; }
+    }
+    double diff = (depth&1) ? y-e.y : x-e.x;
+    if (diff<0.0) {
+        findNearest(lo, mid, depth+1, x, y, best, bestDist);
+        if (diff*diff<bestDist)
+            findNearest(mid+1, hi, depth+1, x, y, best, bestDist);
+    } else {
+        findNearest(mid+1, hi, depth+1, x, y, best, bestDist);
+        if (diff*diff<bestDist)
+            findNearest(lo, mid, depth+1, x, y, best, bestDist);
+    }
+}
+
+
+/**
+ * Visit the toolpaths in nearest neighbor order.
+ *
+ * \param position the head starts here
+ */
+void IATravelOptimizer::orderGreedy(IAVector3d position)
+{
+    pTree.clear();
+    for (int i=0; i<(int)pPath.size(); i++) {
+        const Path &p = pPath[i];
+        pTree.push_back( { p.start.x(), p.start.y(), i, false } );
+        if (p.canFlip && !(p.start==p.end))
+            pTree.push_back( { p.end.x(), p.end.y(), i, true } );
+    }
+    int n = (int)pTree.size();
+    pAlive.assign(n, 0);
+    pUsed.assign(n, 0);
+    buildTree(0, n, 0);
+    pTreeIndex.assign(pPath.size()*2, -1);
+    for (int i=0; i<n; i++)
+        pTreeIndex[pTree[i].path*2 + (pTree[i].reversed ? 1 : 0)] = i;
+
+    pOrder.clear();
+    for (size_t k=0; k<pPath.size(); k++) {
+        int best = -1;
+        double bestDist = HUGE_VAL;
+        findNearest(0, n, 0, position.x(), position.y(), best, bestDist);
+        const Endpoint &e = pTree[best];
+        Path &p = pPath[e.path];
+        p.reversed = e.reversed;
+        removeEndpoint(pTreeIndex[e.path*2]);
+        if (pTreeIndex[e.path*2+1]>=0)
+            removeEndpoint(pTreeIndex[e.path*2+1]);
+        if (pSeam==IAToolpathLoop::NEAREST)
+            moveSeam(p, IAToolpathLoop::NEAREST, position);
+        pOrder.push_back(e.path);
+        position = p.reversed ? p.start : p.end;
+    }
+}
+
+
+/**
+ * Shorten the travel between toolpaths with 2-opt moves.
+ *
+ * Printing a run of toolpaths in reverse order, and every toolpath in the
+ * run backwards, does not change the travel inside the run. Only the
+ * travel into the run and out of it changes, so every move is checked in
+ * constant time.
+ *
+ * \param position the head starts here
+ */
+void IATravelOptimizer::improve(const IAVector3d &position)
+{
+    int n = (int)pOrder.size();
+    auto entry = [this](int k) -> const IAVector3d& {
+        const Path &p = pPath[pOrder[k]];
+        return p.reversed ? p.end : p.start;
+    };
+    auto exit = [this](int k) -> const IAVector3d& {
+        const Path &p = pPath[pOrder[k]];
+        return p.reversed ? p.start : p.end;
+    };
+    for (int pass=0; pass<kTwoOptPasses; pass++) {
+        bool changed = false;
+        for (int i=0; i<n; i++) {
+            for (int j=i; j<n && j<i+kTwoOptWindow; j++) {
+                if (!pPath[pOrder[j]].canFlip) break;
+                const IAVector3d &before = (i==0) ? position : exit(i-1);
+                double oldCost = distance(before, entry(i));
+                double newCost = distance(before, exit(j));
+                if (j+1<n) {
+                    oldCost += distance(exit(j), entry(j+1));
+                    newCost += distance(entry(i), entry(j+1));
+                }
+                if (newCost<oldCost-1e-6) {
+                    std::reverse(pOrder.begin()+i, pOrder.begin()+j+1);
+                    for (int k=i; k<=j; k++)
+                        pPath[pOrder[k]].reversed = !pPath[pOrder[k]].reversed;
+                    changed = true;
+                }
+            }
+        }
+        if (!changed) break;
+    }
+}
+
+
+/**
+ * Reorder a range of toolpaths that share tool, group, and priority.
+ *
+ * Open lines may be reversed. Loops keep their direction, but closed loops
+ * may start at another vertex, depending on the seam placement.
+ *
+ * \param list the list of toolpaths
+ * \param first, last the range of toolpaths that may be reordered
+ * \param position the head starts here; receives the position of the head
+ *      after the last toolpath
+ */
+void IATravelOptimizer::optimize(IAToolpathTypeList &list, size_t first, size_t last,
+                                 IAVector3d &position)
+{
+    pPath.clear();
+    std::vector<IAToolpath*> empty;
+    for (size_t i=first; i<last; i++) {
+        IAToolpath *tp = list[i];
+        const IAToolpathVertexList &v = tp->vertices();
+        if (v.empty()) {
+            empty.push_back(tp);
+            continue;
+        }
+        IAVector3d start(v.front().x, v.front().y, tp->pZ);
+        IAVector3d end(v.back().x, v.back().y, tp->pZ);
+        bool canFlip = tp->canReverse() || start==end;
+        pPath.push_back( { tp, start, end, canFlip, false } );
+        if (pSeam!=IAToolpathLoop::NEAREST)
+            moveSeam(pPath.back(), pSeam, position);
+    }
+    if (pPath.empty()) return;
+
+    orderGreedy(position);
+    improve(position);
+
+    size_t i = first;
+    for (int k: pOrder) {
+        Path &p = pPath[k];
+        if (p.reversed && p.toolpath->canReverse())
+            p.toolpath->reverse();
+        list[i++] = p.toolpath;
+    }
+    for (auto tp: empty)
+        list[i++] = tp;
+    const Path &p = pPath[pOrder.back()];
+    position = p.reversed ? p.start : p.end;
+}
+
@@ -0,0 +1,91 @@
+//
+//  IATravelOptimizer.h
+//
+//  Copyright (c) 2013-2018 Matthias Melcher. All rights reserved.
+//
+
+#ifndef IA_TRAVEL_OPTIMIZER_H
+#define IA_TRAVEL_OPTIMIZER_H
+
+
+#include "toolpath/IAToolpath.h"
+
+#include <vector>
+
+
+/**
+ * Order toolpaths so that the head travels as little as possible.
+ *
+ * The start point of every toolpath, and the end point of every toolpath
+ * that can be printed backwards, go into a k-d tree. Starting at the
+ * current head position, the nearest endpoint that is not used yet is
+ * found in the tree, and the head continues from the other end of that
+ * toolpath.
+ *
+ * The greedy order is then improved with a 2-opt pass: a run of toolpaths
+ * is printed in reverse order if that shortens the travel into and out of
+ * the run. The pass only looks at a window of neighboring toolpaths, so the
+ * cost stays linear in the number of toolpaths.
+ *
+ * Closed loops can start at any of their vertices. Aligned and corner seams
+ * are chosen before the tour is planned. Nearest seams are moved to the
+ * vertex closest to the head when the loop is visited.
+ */
+class IATravelOptimizer
+{
+public:
+    IATravelOptimizer(IAToolpathLoop::Seam seam=IAToolpathLoop::NEAREST);
+
+    void optimize(IAToolpathTypeList &list, size_t first, size_t last,
+                  IAVector3d &position);
+
+protected:
+    /** Start or end point of a toolpath. */
+    struct Endpoint {
+        double x, y;
+        /** Index into pPath */
+        int path;
+        /** Set if the head must enter the toolpath at its end */
+        bool reversed;
+    };
+
+    /** A toolpath and how it will be printed. */
+    struct Path {
+        IAToolpath *toolpath;
+        /** Where the head enters and leaves this path */
+        IAVector3d start, end;
+        /** Set if the path can be printed backwards, or if start and end are the same */
+        bool canFlip;
+        bool reversed;
+    };
+
+    void moveSeam(Path &p, IAToolpathLoop::Seam seam, const IAVector3d &position);
+    void buildTree(int lo, int hi, int depth);
+    void removeEndpoint(int e);
+    void findNearest(int lo, int hi, int depth, double x, double y,
+                     int &best, double &bestDist) const;
+    void orderGreedy(IAVector3d position);
+    void improve(const IAVector3d &position);
+
+    IAToolpathLoop::Seam pSeam = IAToolpathLoop::NEAREST;
+
+    std::vector<Path> pPath;
+
+    /** The k-d tree is stored in place: every range [lo, hi) has its node at (lo+hi)/2 */
+    std::vector<Endpoint> pTree;
+
+    /** Number of endpoints in the subtree of every node that are not used yet */
+    std::vector<int> pAlive;
+
+    /** Position of every endpoint in pTree, two entries per path */
+    std::vector<int> pTreeIndex;
+
+    /** Set if the endpoint at the same position in pTree is used */
+    std::vector<char> pUsed;
+
+    /** Indices into pPath in the order of printing */
+    std::vector<int> pOrder;
+};
+
+
+#endif /* IA_TRAVEL_OPTIMIZER_H */